@@ -68,6 +68,7 @@
 #define PANEL_RES_X 64 // Number of pixels wide of each INDIVIDUAL panel module.
 #define PANEL_RES_Y 32 // Number of pixels tall of each INDIVIDUAL panel module.
 #define PANEL_CHAIN 1  // Total number of panels chained one to another
+#define PANEL_DOUBLE_BUFFER false // Tear-free flips, for a second DMA frame buffer. See /stats display_dma_bytes.
 
 
 #endif
\ No newline at end of file
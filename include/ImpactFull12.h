@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <Adafruit_GFX.h>
+#include "TextMetrics.h"
 
 const uint8_t impact12p_bitmaps[] PROGMEM = {
   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFD, 0xE7, 0x38, 0x1F, 0xFF, 0xFE,
@@ -113,7 +114,7 @@ const uint8_t impact12p_bitmaps[] PROGMEM = {
   0xF0, 0xF8, 0xFC, 0x7C, 0x3E, 0x1F, 0x1F, 0x0F, 0x87, 0xC7, 0xC3, 0xE1,
   0xF1, 0xFF, 0xFF, 0xFF, 0xFF, 0xE0 };
 
-const GFXglyph c__Windows_Fonts_impact12pt7bGlyphs[] PROGMEM = {
+constexpr GFXglyph c__Windows_Fonts_impact12pt7bGlyphs[] PROGMEM = {
   {     0,   0,   0,   4,    0,    1 },   // 0x20 ' '
   {     0,   5,  19,   6,    1,  -18 },   // 0x21 '!'
   {    12,   8,   6,   9,    0,  -18 },   // 0x22 '"'
@@ -178,5 +179,6 @@ const GFXfont Impact12Caps PROGMEM = {
   (uint8_t  *)impact12p_bitmaps,
   (GFXglyph *)c__Windows_Fonts_impact12pt7bGlyphs,
   0x20, 0x5A, 29 };
+constexpr FontMetrics Impact12CapsMetrics = {c__Windows_Fonts_impact12pt7bGlyphs, 0x20, 0x5A, 29};
 
 // Approx. 1734 bytes
@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <Adafruit_GFX.h>
+#include "TextMetrics.h"
 /**
 ** The original 3x5 font is licensed under the 3-clause BSD license:
 **
@@ -269,7 +270,7 @@ const uint8_t TomThumbBitmaps[] PROGMEM = {
 };
 
 /* {offset, width, height, advance cursor, x offset, y offset} */
-const GFXglyph TomThumbGlyphs[] PROGMEM = {
+constexpr GFXglyph TomThumbGlyphs[] PROGMEM = {
     {0, 1, 1, 2, 0, -5},   /* 0x20 space */
     {1, 1, 5, 2, 0, -5},   /* 0x21 exclam */
     {2, 3, 2, 4, 0, -5},   /* 0x22 quotedbl */
@@ -480,6 +481,7 @@ const GFXglyph TomThumbGlyphs[] PROGMEM = {
 
 const GFXfont TomThumb PROGMEM = {(uint8_t *)TomThumbBitmaps,
                                   (GFXglyph *)TomThumbGlyphs, 0x20, 0x7E, 6};
+constexpr FontMetrics TomThumbMetrics = {TomThumbGlyphs, 0x20, 0x7E, 6};
 
 
 #endif /* TOMTHUMB_USE_EXTENDED */
\ No newline at end of file
@@ -2,10 +2,110 @@
 #define CC_ESP_HUB75_MatrixPanel_h
 
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
+#include "TextMetrics.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_heap_caps.h>
+#endif
 
 // Add some utility functions. This works, but is sloppy. CAC
+//
+// Drawing goes to a shadow copy of the screen, not the DMA buffer. flush() then
+// sends only the pixels that differ from what the panel already shows, so a
+// fillScreen() and redraw of the same thing costs nothing on the panel and doesn't
+// flicker. Call flush() once everything for the frame is drawn.
+//
+// With double_buff set in the config the DMA library keeps two frame buffers, and
+// flush() draws into the one not being shown and flips to it at the end of a
+// refresh. The panel then never shows half a frame, e.g. the black screen before
+// the new state word. It costs a second DMA buffer, see dmaBytes(), and a second
+// copy of the screen here to know what the back buffer holds.
+// Brightness changes also wait for flush(), so they land with the frame they go with.
+//
+// Text doesn't go through Adafruit_GFX's drawChar(), which reads the font bitmap
+// from flash a bit at a time and draws one pixel per call. The first time a glyph
+// is used it's expanded into one bitmask per row, bit n for column n, and after
+// that it's drawn a run of set bits at a time straight into the shadow buffer.
+// Glyphs wider than 31, scaled text, and anything once the cache is full still
+// go the slow way.
+//
+// All the print helpers format into one fixed arena and share one layout routine,
+// printText(). printIn() adds a cache per screen area, so a line redrawn five times
+// a second with the same text costs a vsnprintf and a compare.
+//
+// The scroller renders its message once, at its measured width, into a strip of
+// column bitmasks off screen. Each frame copies a screen-wide window of it, so a
+// frame costs the same however long the message is. Where the window sits comes
+// from the time since the message started, not from counting frames, so a late
+// loop() skips pixels rather than slowing the scroll down.
 
 #define MAX_SCROLL_MSG_LEN 256
+#define SHADOW_WIDTH 64
+#define SHADOW_HEIGHT 32
+#define GLYPH_CACHE_FONTS 2     // TomThumb and Impact12Caps
+#define GLYPH_CACHE_GLYPHS 96   // Most distinct glyphs cached, over all fonts
+#define GLYPH_CACHE_ROWS 1024   // Row masks shared between them. Impact caps are 19 rows.
+#define TEXT_ARENA_SIZE 128     // Longest formatted text; longer is cut off
+#define TEXT_AREAS 4            // Screen areas printIn() remembers
+#define TEXT_AREA_CHARS 32      // Longest text it remembers per area
+#define SCROLL_STRIP_WIDTH 1024 // Widest scroller message in pixels; the rest is cut off
+#define SCROLL_STRIP_ROWS 7     // Rows above and including the baseline. Fits TomThumb.
+#define SCROLL_GAP 64           // Blank pixels before the message comes round again
+
+struct PanelFlushStats
+{
+    uint32_t frames;      // Flushes that sent any pixels
+    uint32_t lastPixels;  // Pixels sent to the panel by the last such flush
+    uint32_t peakPixels;  // ...the most by any one
+    uint32_t totalPixels; // ...by all of them
+    uint32_t drawnPixels; // Pixels drawn into the shadow, changed or not
+    uint32_t flips;       // Double buffered only
+};
+
+enum class TextAlign : uint8_t
+{
+    LEFT,  // x is where the text starts
+    RIGHT, // ...where it ends
+    CENTER // ...its middle
+};
+
+// A part of the screen that belongs to one line of text, see printIn().
+struct TextArea
+{
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+};
+
+struct TextAreaCache
+{
+    TextArea area;
+    bool used;
+    bool valid; // What's in text is what's on the screen there
+    TextAlign align;
+    int16_t x;
+    int16_t y;
+    uint16_t color;
+    const GFXfont *font;
+    uint8_t len;
+    char text[TEXT_AREA_CHARS];
+};
+
+struct TextStats
+{
+    uint32_t drawn;   // printIn() calls that drew
+    uint32_t skipped; // ...that found the same text already there
+};
+
+struct CachedGlyph
+{
+    uint16_t row; // First of its masks in the row pool
+    uint8_t width;
+    uint8_t height;
+    uint8_t xAdvance;
+    int8_t xOffset;
+    int8_t yOffset;
+};
 
 class MatrixPanel_CC : public MatrixPanel_I2S_DMA
 {
@@ -13,19 +113,297 @@ private:
     static MatrixPanel_CC *instance;
     char _scrollerMessage[MAX_SCROLL_MSG_LEN] = "";
     int _scrollMessageY = 31;
-    int _scrollMs = 50;
-    int _scrollOffset = 63; // Screen width
-    unsigned long _lastScrollUpdate = 0;
+    int _scrollMs = 50; // Per pixel
+    unsigned long _scrollStart = 0;
+    long _scrollPos = -1; // Pixels scrolled as last drawn, -1 to draw on the next call
+    bool _scrollStarted = false;
+
+    // The message as rendered, one column per entry, bit n for row n of the strip.
+    // Rendered in _stripFont; nullptr means it needs doing.
+    uint8_t _strip[SCROLL_STRIP_WIDTH];
+    uint16_t _stripWidth = 0;
+    const GFXfont *_stripFont = nullptr;
+
+    // What we've drawn, and what each DMA buffer holds. The dirty box bounds where the
+    // shadow may differ from the front buffer, the behind box where the back buffer
+    // may additionally differ from it. Single buffered, front is the only buffer and
+    // there's no back one, as it'd be 4K of internal RAM doing nothing.
+    uint16_t _shadow[SHADOW_HEIGHT][SHADOW_WIDTH] = {};
+    uint16_t _first[SHADOW_HEIGHT][SHADOW_WIDTH] = {};
+    uint16_t (*_front)[SHADOW_WIDTH] = _first;
+    uint16_t (*_back)[SHADOW_WIDTH] = nullptr; // Only when double buffered
+    int16_t _dirtyX0 = SHADOW_WIDTH;
+    int16_t _dirtyY0 = SHADOW_HEIGHT;
+    int16_t _dirtyX1 = -1;
+    int16_t _dirtyY1 = -1;
+    int16_t _behindX0 = SHADOW_WIDTH;
+    int16_t _behindY0 = SHADOW_HEIGHT;
+    int16_t _behindX1 = -1;
+    int16_t _behindY1 = -1;
+    bool _doubleBuffered;
+    int _brightness = -1; // Waiting for flush(), -1 for no change
+    size_t _dmaBytes = 0;
+    PanelFlushStats _flushStats = {};
+
+    // Glyph cache. _glyphIndex holds entry + 1 per font and character, 0 if not cached.
+    const GFXfont *_glyphFonts[GLYPH_CACHE_FONTS] = {};
+    uint8_t _glyphIndex[GLYPH_CACHE_FONTS][96] = {};
+    CachedGlyph _glyphs[GLYPH_CACHE_GLYPHS];
+    uint32_t _glyphRows[GLYPH_CACHE_ROWS];
+    uint8_t _glyphFont = 0; // Slot of the last font used
+    uint8_t _glyphCount = 0;
+    uint16_t _glyphRowCount = 0;
+    bool _useGlyphCache = true;
+
+    // Text layout. One arena for whatever's being formatted, and what printIn() last
+    // drew in each area.
+    char _textArena[TEXT_ARENA_SIZE];
+    TextAreaCache _areas[TEXT_AREAS] = {};
+    uint8_t _nextArea = 0;
+    uint16_t _textBackground = 0;
+    TextStats _textStats = {};
+
+    TextAreaCache &areaCache(const TextArea &area)
+    {
+        for (TextAreaCache &c : _areas)
+            if (c.used && c.area.x == area.x && c.area.y == area.y && c.area.w == area.w && c.area.h == area.h)
+                return c;
+        TextAreaCache &c = _areas[_nextArea];
+        _nextArea = (_nextArea + 1) % TEXT_AREAS;
+        c.used = true;
+        c.valid = false;
+        c.area = area;
+        return c;
+    }
+
+    void placeText(TextAlign align, int16_t x, int16_t y, const char *text)
+    {
+        if (align == TextAlign::RIGHT)
+            x -= measure(text).w;
+        else if (align == TextAlign::CENTER)
+            x -= measure(text).w / 2;
+        setCursor(x, y);
+    }
+
+    void markDirty(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+    {
+        for (TextAreaCache &c : _areas)
+            if (c.valid && x0 < c.area.x + c.area.w && x1 >= c.area.x && y0 < c.area.y + c.area.h && y1 >= c.area.y)
+                c.valid = false;
+        if (x0 < _dirtyX0)
+            _dirtyX0 = x0;
+        if (y0 < _dirtyY0)
+            _dirtyY0 = y0;
+        if (x1 > _dirtyX1)
+            _dirtyX1 = x1;
+        if (y1 > _dirtyY1)
+            _dirtyY1 = y1;
+    }
+
+    void shadowFill(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+    {
+        int16_t x1 = x + w;
+        int16_t y1 = y + h;
+        if (x < 0)
+            x = 0;
+        if (y < 0)
+            y = 0;
+        if (x1 > SHADOW_WIDTH)
+            x1 = SHADOW_WIDTH;
+        if (y1 > SHADOW_HEIGHT)
+            y1 = SHADOW_HEIGHT;
+        if (x >= x1 || y >= y1)
+            return;
+
+        for (int16_t row = y; row < y1; row++)
+            for (int16_t col = x; col < x1; col++)
+                _shadow[row][col] = color;
+        _flushStats.drawnPixels += (x1 - x) * (y1 - y);
+        markDirty(x, y, x1 - 1, y1 - 1);
+    }
+
+    // The cached form of c in the current font, expanding it if this is its first use.
+    // nullptr if it can't be cached.
+    const CachedGlyph *cachedGlyph(uint8_t c)
+    {
+        uint8_t first = pgm_read_byte(&gfxFont->first);
+        if (c < first || c > pgm_read_byte(&gfxFont->last) || c < 0x20 || c >= 0x80)
+            return nullptr;
+
+        int font = _glyphFont;
+        if (_glyphFonts[font] != gfxFont)
+        {
+            font = 0;
+            while (font < GLYPH_CACHE_FONTS && _glyphFonts[font] && _glyphFonts[font] != gfxFont)
+                font++;
+            if (font == GLYPH_CACHE_FONTS)
+                return nullptr;
+            _glyphFonts[font] = gfxFont;
+            _glyphFont = font;
+        }
+        uint8_t &index = _glyphIndex[font][c - 0x20];
+        if (index)
+            return &_glyphs[index - 1];
+
+        const GFXglyph *glyph = &((const GFXglyph *)pgm_read_pointer(&gfxFont->glyph))[c - first];
+        const uint8_t *bitmap = (const uint8_t *)pgm_read_pointer(&gfxFont->bitmap);
+        CachedGlyph g;
+        g.row = _glyphRowCount;
+        g.width = pgm_read_byte(&glyph->width);
+        g.height = pgm_read_byte(&glyph->height);
+        g.xAdvance = pgm_read_byte(&glyph->xAdvance);
+        g.xOffset = pgm_read_byte(&glyph->xOffset);
+        g.yOffset = pgm_read_byte(&glyph->yOffset);
+        if (g.width > 31 || _glyphCount == GLYPH_CACHE_GLYPHS || _glyphRowCount + g.height > GLYPH_CACHE_ROWS)
+            return nullptr;
+
+        // Font bitmaps run on from row to row, MSB first.
+        uint16_t bo = pgm_read_word(&glyph->bitmapOffset);
+        uint8_t bits = 0, bit = 0;
+        for (uint8_t y = 0; y < g.height; y++)
+        {
+            uint32_t mask = 0;
+            for (uint8_t x = 0; x < g.width; x++)
+            {
+                if (!(bit++ & 7))
+                    bits = pgm_read_byte(&bitmap[bo++]);
+                if (bits & 0x80)
+                    mask |= 1u << x;
+                bits <<= 1;
+            }
+            _glyphRows[_glyphRowCount++] = mask;
+        }
+        _glyphs[_glyphCount] = g;
+        index = ++_glyphCount;
+        return &_glyphs[index - 1];
+    }
+
+    void blitGlyph(const CachedGlyph &g, int16_t x, int16_t y, uint16_t color)
+    {
+        x += g.xOffset;
+        y += g.yOffset;
+        int16_t top = y < 0 ? -y : 0;
+        int16_t bottom = y + g.height > SHADOW_HEIGHT ? SHADOW_HEIGHT - y : g.height;
+        if (top >= bottom || x >= SHADOW_WIDTH || x + g.width <= 0)
+            return;
+
+        // Clip the masks to the screen once, for every row.
+        int16_t left = x < 0 ? -x : 0;
+        int16_t right = x + g.width > SHADOW_WIDTH ? SHADOW_WIDTH - x : g.width;
+        uint32_t clip = ((1u << right) - 1) & ~((1u << left) - 1);
+
+        const uint32_t *rows = &_glyphRows[g.row];
+        for (int16_t r = top; r < bottom; r++)
+        {
+            uint32_t bits = rows[r] & clip;
+            while (bits)
+            {
+                int start = __builtin_ctz(bits);
+                int run = __builtin_ctz(~(bits >> start));
+                for (uint16_t *p = &_shadow[y + r][x + start], *end = p + run; p < end; p++)
+                    *p = color;
+                _flushStats.drawnPixels += run;
+                bits &= ~(((1u << run) - 1) << start);
+            }
+        }
+        markDirty(x + left, y + top, x + right - 1, y + bottom - 1);
+    }
 
     // Private constructor
     MatrixPanel_CC(const HUB75_I2S_CFG &opts)
-        : MatrixPanel_I2S_DMA{opts}
+        : MatrixPanel_I2S_DMA{opts}, _doubleBuffered(opts.double_buff)
+    {
+        if (_doubleBuffered)
+            _back = new uint16_t[SHADOW_HEIGHT][SHADOW_WIDTH]();
+    }
+
+    // Bring buffer in line with the shadow over a box. Runs of the same colour go to
+    // the DMA buffer as one line. Returns the pixels sent.
+    uint32_t pushChanges(uint16_t (*buffer)[SHADOW_WIDTH], int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+    {
+        uint32_t written = 0;
+        for (int16_t y = y0; y <= y1; y++)
+        {
+            if (!memcmp(&_shadow[y][x0], &buffer[y][x0], (x1 - x0 + 1) * sizeof(uint16_t)))
+                continue;
+            int16_t x = x0;
+            while (x <= x1)
+            {
+                uint16_t color = _shadow[y][x];
+                if (color == buffer[y][x])
+                {
+                    x++;
+                    continue;
+                }
+                int16_t run = x;
+                while (run <= x1 && _shadow[y][run] == color && buffer[y][run] != color)
+                    buffer[y][run++] = color;
+                if (run - x == 1)
+                    MatrixPanel_I2S_DMA::drawPixel(x, y, color);
+                else
+                    MatrixPanel_I2S_DMA::drawFastHLine(x, y, run - x, color);
+                written += run - x;
+                x = run;
+            }
+        }
+        return written;
+    }
+
+    bool differs(uint16_t (*buffer)[SHADOW_WIDTH], int16_t x0, int16_t y0, int16_t x1, int16_t y1)
     {
+        for (int16_t y = y0; y <= y1; y++)
+            if (memcmp(&_shadow[y][x0], &buffer[y][x0], (x1 - x0 + 1) * sizeof(uint16_t)))
+                return true;
+        return false;
+    }
+
+    // Draw the scroller message into the strip in the current font, with no wrapping,
+    // straight from the font bitmap. Only happens when the message or font changes.
+    void renderStrip()
+    {
+        memset(_strip, 0, sizeof(_strip));
+        _stripFont = gfxFont;
+        TextBounds bounds = measure(_scrollerMessage);
+        int32_t width = bounds.w ? bounds.x1 + bounds.w : 0;
+        _stripWidth = width > SCROLL_STRIP_WIDTH ? SCROLL_STRIP_WIDTH : width < 0 ? 0 : width;
+        if (!gfxFont)
+            return;
+
+        uint8_t first = pgm_read_byte(&gfxFont->first), last = pgm_read_byte(&gfxFont->last);
+        const GFXglyph *glyphs = (const GFXglyph *)pgm_read_pointer(&gfxFont->glyph);
+        const uint8_t *bitmap = (const uint8_t *)pgm_read_pointer(&gfxFont->bitmap);
+        int16_t cursor = 0;
+        for (const char *p = _scrollerMessage; *p && cursor < _stripWidth; p++)
+        {
+            uint8_t c = *p;
+            if (c < first || c > last)
+                continue;
+            const GFXglyph *glyph = &glyphs[c - first];
+            uint8_t w = pgm_read_byte(&glyph->width), h = pgm_read_byte(&glyph->height);
+            int8_t xo = pgm_read_byte(&glyph->xOffset), yo = pgm_read_byte(&glyph->yOffset);
+            uint16_t bo = pgm_read_word(&glyph->bitmapOffset);
+            uint8_t bits = 0, bit = 0;
+            for (uint8_t yy = 0; yy < h; yy++)
+            {
+                int16_t row = SCROLL_STRIP_ROWS - 1 + yo + yy; // The baseline is the last row
+                for (uint8_t xx = 0; xx < w; xx++)
+                {
+                    if (!(bit++ & 7))
+                        bits = pgm_read_byte(&bitmap[bo++]);
+                    int16_t col = cursor + xo + xx;
+                    if ((bits & 0x80) && row >= 0 && row < SCROLL_STRIP_ROWS && col >= 0 && col < _stripWidth)
+                        _strip[col] |= 1 << row;
+                    bits <<= 1;
+                }
+            }
+            cursor += pgm_read_byte(&glyph->xAdvance);
+        }
     }
 
 public:
     // Delete copy constructor and assignment operator
     MatrixPanel_CC(const MatrixPanel_CC &) = delete;
+    ~MatrixPanel_CC() { delete[] _back; }
     void operator=(const MatrixPanel_CC &) = delete;
 
     // Static method to get the instance
@@ -46,13 +424,157 @@ public:
     //     return instance;
     // }
 
+    // Text in a GFXfont at size 1 is drawn from the glyph cache. The rest, and the
+    // handling of \n, wrapping and cursor moves where it isn't, is Adafruit_GFX's.
+    using MatrixPanel_I2S_DMA::write;
+    size_t write(uint8_t c)
+    {
+        const CachedGlyph *g = nullptr;
+        if (_useGlyphCache && gfxFont && textsize_x == 1 && textsize_y == 1)
+            g = cachedGlyph(c);
+        if (!g)
+            return MatrixPanel_I2S_DMA::write(c);
+
+        if (g->width && g->height)
+        {
+            if (wrap && cursor_x + g->xOffset + g->width > _width)
+            {
+                cursor_x = 0;
+                cursor_y += (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+            }
+            blitGlyph(*g, cursor_x, cursor_y, textcolor);
+        }
+        cursor_x += g->xAdvance;
+        return 1;
+    }
+
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            MatrixPanel_CC::write(buffer[i]);
+        return size;
+    }
+
+    // Off draws every glyph through Adafruit_GFX again, for comparison.
+    void useGlyphCache(bool on) { _useGlyphCache = on; }
+
+    // Everything else Adafruit_GFX draws comes through these.
+    void drawPixel(int16_t x, int16_t y, uint16_t color)
+    {
+        shadowFill(x, y, 1, 1, color);
+    }
+
+    void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+    {
+        shadowFill(x, y, w, 1, color);
+    }
+
+    void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+    {
+        shadowFill(x, y, 1, h, color);
+    }
+
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+    {
+        shadowFill(x, y, w, h, color);
+    }
+
+    void fillScreen(uint16_t color)
+    {
+        shadowFill(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, color);
+    }
+
+    // Measures what the DMA buffers took, so the double buffering cost can be weighed.
+    bool begin()
+    {
+#ifdef ARDUINO_ARCH_ESP32
+        size_t before = heap_caps_get_free_size(MALLOC_CAP_DMA);
+#endif
+        bool ok = MatrixPanel_I2S_DMA::begin();
+#ifdef ARDUINO_ARCH_ESP32
+        _dmaBytes = before - heap_caps_get_free_size(MALLOC_CAP_DMA);
+#endif
+        return ok;
+    }
+
+    void setBrightness8(uint8_t brightness)
+    {
+        _brightness = brightness;
+    }
+
+    // Send what changed since the last flush to the panel, flipping buffers if double
+    // buffered. Returns the pixels sent.
+    uint32_t flush()
+    {
+        uint32_t written = 0;
+        if (!_doubleBuffered)
+            written = pushChanges(_front, _dirtyX0, _dirtyY0, _dirtyX1, _dirtyY1);
+        else
+        {
+            // The back buffer is a frame behind the front one, so it needs this frame's
+            // changes and the last one's.
+            int16_t x0 = min(_dirtyX0, _behindX0);
+            int16_t y0 = min(_dirtyY0, _behindY0);
+            int16_t x1 = max(_dirtyX1, _behindX1);
+            int16_t y1 = max(_dirtyY1, _behindY1);
+            bool changed = differs(_front, _dirtyX0, _dirtyY0, _dirtyX1, _dirtyY1);
+            written = pushChanges(_back, x0, y0, x1, y1);
+            if (changed)
+            {
+                flipDMABuffer();
+                uint16_t(*shown)[SHADOW_WIDTH] = _back;
+                _back = _front;
+                _front = shown;
+                _flushStats.flips++;
+                _behindX0 = _dirtyX0;
+                _behindY0 = _dirtyY0;
+                _behindX1 = _dirtyX1;
+                _behindY1 = _dirtyY1;
+            }
+            else
+            {
+                _behindX0 = SHADOW_WIDTH;
+                _behindY0 = SHADOW_HEIGHT;
+                _behindX1 = _behindY1 = -1;
+            }
+        }
+        _dirtyX0 = SHADOW_WIDTH;
+        _dirtyY0 = SHADOW_HEIGHT;
+        _dirtyX1 = _dirtyY1 = -1;
+
+        if (_brightness >= 0)
+        {
+            MatrixPanel_I2S_DMA::setBrightness8(_brightness);
+            _brightness = -1;
+        }
+
+        if (written)
+        {
+            _flushStats.frames++;
+            _flushStats.lastPixels = written;
+            _flushStats.totalPixels += written;
+            if (written > _flushStats.peakPixels)
+                _flushStats.peakPixels = written;
+        }
+        return written;
+    }
+
+    bool doubleBuffered() const { return _doubleBuffered; }
+    // What the panel shows as of the last flush(), 64x32 RGB565 row by row.
+    const uint16_t *frontFrame() const { return &_front[0][0]; }
+    size_t dmaBytes() const { return _dmaBytes; }
+    size_t shadowBytes() const { return sizeof(_shadow) + sizeof(_first) * (_back ? 2 : 1); }
+    const PanelFlushStats &flushStats() const { return _flushStats; }
+
     int setScrollMessage(const char *msg)
     {
         if (!strncmp(_scrollerMessage, msg, MAX_SCROLL_MSG_LEN))
             return 0;
-        strncpy(_scrollerMessage, msg, MAX_SCROLL_MSG_LEN);
-        _scrollOffset = 63;
-        _lastScrollUpdate = 0;
+        strncpy(_scrollerMessage, msg, MAX_SCROLL_MSG_LEN - 1);
+        _scrollerMessage[MAX_SCROLL_MSG_LEN - 1] = 0;
+        _stripFont = nullptr;
+        _scrollStarted = false;
+        _scrollPos = -1;
         Serial.printf("Msg now: %s", msg);
         return strlen(_scrollerMessage);
     }
@@ -60,151 +582,202 @@ public:
     void setScrollMessageLine(int y)
     {
         _scrollMessageY = y;
+        _scrollPos = -1;
     }
 
+    // Draw the scroller where it should be by now, in the current font. Returns the
+    // pixels left before the message comes round again, or 0 if nothing was drawn.
     int scrollText()
     {
-        if (millis() - _lastScrollUpdate < _scrollMs)
+        if (!_scrollerMessage[0])
             return 0;
-        _lastScrollUpdate = millis();
+        if (_stripFont != gfxFont)
+            renderStrip();
 
-        if (!strlen(_scrollerMessage))
+        unsigned long now = millis();
+        if (!_scrollStarted)
+        {
+            _scrollStart = now;
+            _scrollStarted = true;
+        }
+        // The message enters at the right edge and goes round once it and the gap
+        // have passed the left.
+        long cycle = SHADOW_WIDTH + _stripWidth + SCROLL_GAP;
+        long pos = (long)((now - _scrollStart) / _scrollMs % cycle);
+        if (pos == _scrollPos)
             return 0;
+        _scrollPos = pos;
 
-        int msgLen = strlen(_scrollerMessage);
+        int16_t top = _scrollMessageY - (SCROLL_STRIP_ROWS - 1);
+        int16_t first = top < 0 ? -top : 0;
+        int16_t rows = top + SCROLL_STRIP_ROWS > SHADOW_HEIGHT ? SHADOW_HEIGHT - top : SCROLL_STRIP_ROWS;
+        if (first >= rows)
+            return cycle - pos;
 
-        setTextWrap(false);
-        setCursor(_scrollOffset, _scrollMessageY);
-        writeFillRect(0, _scrollMessageY - 6, 64, 7, 0);
-        setTextColor(color444(15, 15, 15));
+        // Copy the window. Columns before or after the message are blank.
+        uint16_t color = color444(15, 15, 15);
+        long start = pos - (SHADOW_WIDTH - 1); // Strip column under screen column 0
+        for (int16_t x = 0; x < SHADOW_WIDTH; x++)
+        {
+            long col = start + x;
+            uint8_t bits = col >= 0 && col < _stripWidth ? _strip[col] : 0;
+            for (int16_t r = first; r < rows; r++)
+                _shadow[top + r][x] = (bits >> r) & 1 ? color : 0;
+        }
+        _flushStats.drawnPixels += SHADOW_WIDTH * (rows - first);
+        markDirty(0, top + first, SHADOW_WIDTH - 1, top + rows - 1);
+        return cycle - pos;
+    }
 
-        printf(_scrollerMessage);
-        _scrollOffset--;
-        // 16 extra characters. 4 pixel font width typical. screen max x 63
-        // Should use get text bounds, but that feels expensive.
-        if (_scrollOffset < -((msgLen + 16) * 4))
-            _scrollOffset = 63;
+    // The current font's measure of text, without making a String of it.
+    TextBounds measure(const char *text)
+    {
+        if (!gfxFont)
+        {
+            TextBounds b;
+            getTextBounds(text, 0, 0, &b.x1, &b.y1, &b.w, &b.h);
+            return b;
+        }
+        FontMetrics font = {(const GFXglyph *)pgm_read_pointer(&gfxFont->glyph), (uint8_t)pgm_read_byte(&gfxFont->first),
+                            (uint8_t)pgm_read_byte(&gfxFont->last), (uint8_t)pgm_read_byte(&gfxFont->yAdvance)};
+        return measureText(font, text);
+    }
 
-        return _scrollOffset - ((msgLen + 16) * 4); // return pixels left to scroll
+    // Every print helper comes down to this: format into the arena, truncating
+    // rather than allocating, and draw aligned on x. Returns the characters drawn.
+    size_t printText(TextAlign align, int16_t x, int16_t y, const char *format, va_list args)
+    {
+        int len = vsnprintf(_textArena, sizeof(_textArena), format, args);
+        if (len < 0)
+            return 0;
+        if (len >= (int)sizeof(_textArena))
+            len = sizeof(_textArena) - 1;
+        placeText(align, x, y, _textArena);
+        return write((const uint8_t *)_textArena, len);
     }
 
     size_t printAt(int16_t x, int16_t y, const char *format, ...)
     {
-        setCursor(x, y);
-        va_list argp;
-        va_start(argp, format);
-        size_t retval = vprintf(format, argp);
-        va_end(argp);
-        // Serial.print("P:%s %s", format, argp);
-        // Serial.printf("argp: %s", argp);
-        return (retval);
+        va_list args;
+        va_start(args, format);
+        size_t retval = printText(TextAlign::LEFT, x, y, format, args);
+        va_end(args);
+        return retval;
     }
+
     size_t printAt(int16_t x, int16_t y, uint16_t color, const char *format, ...)
     {
-        setCursor(x, y);
         setTextColor(color);
-        va_list argp;
-        va_start(argp, format);
-        size_t retval = vprintf(format, argp);
-        va_end(argp);
-        // Serial.printf("P:%s %s", format, argp);
-        // Serial.printf("argp: %s", argp);
-        return (retval);
+        va_list args;
+        va_start(args, format);
+        size_t retval = printText(TextAlign::LEFT, x, y, format, args);
+        va_end(args);
+        return retval;
     }
 
-    size_t vprintf(const char *format, va_list arg)
+    // At the cursor, like Print::printf().
+    size_t vprintf(const char *format, va_list args)
     {
-        char loc_buf[128];
-        char *temp = loc_buf;
-        int len = vsnprintf(temp, sizeof(loc_buf), format, arg);
-        if (len < 0)
-        {
-            return 0;
-        };
-        if (len >= sizeof(loc_buf))
-        {
-            temp = (char *)malloc(len + 1);
-            if (temp == NULL)
-            {
-                return 0;
-            }
-            len = vsnprintf(temp, len + 1, format, arg);
-        }
-        len = write((uint8_t *)temp, len);
-        if (temp != loc_buf)
-        {
-            free(temp);
-        }
-        return len;
+        return printText(TextAlign::LEFT, cursor_x, cursor_y, format, args);
     }
 
     size_t printRight(uint16_t x, uint16_t y, const char *format, ...)
     {
-        char buf[128];
         va_list args;
         va_start(args, format);
-        vsnprintf(buf, 127, format, args);
+        size_t retval = printText(TextAlign::RIGHT, x, y, format, args);
         va_end(args);
-
-        int16_t x1, y1;
-        uint16_t w, h;
-        const String text = buf;
-        getTextBounds(text, 0, 12, &x1, &y1, &w, &h);
-        setCursor(x - w, y);
-        size_t retval = print(buf);
-        return (retval);
+        return retval;
     }
 
     size_t printRight(uint16_t x, uint16_t y, uint16_t color, const char *format, ...)
     {
-        char buf[128];
+        setTextColor(color);
         va_list args;
         va_start(args, format);
-        vsnprintf(buf, 127, format, args);
+        size_t retval = printText(TextAlign::RIGHT, x, y, format, args);
         va_end(args);
-
-        setTextColor(color);
-        int16_t x1, y1;
-        uint16_t w, h;
-        const String text = buf;
-        getTextBounds(text, 0, 12, &x1, &y1, &w, &h);
-        setCursor(x - w, y);
-        size_t retval = print(buf);
-        return (retval);
+        return retval;
     }
 
     size_t printCenter(uint16_t x, uint16_t y, const char *format, ...)
     {
-        char buf[128];
         va_list args;
         va_start(args, format);
-        vsnprintf(buf, 127, format, args);
+        size_t retval = printText(TextAlign::CENTER, x, y, format, args);
         va_end(args);
-
-        int16_t x1, y1;
-        uint16_t w, h;
-        const String text = buf;
-        getTextBounds(text, 0, 12, &x1, &y1, &w, &h);
-        setCursor(x - (w / 2), y);
-        size_t retval = print(buf);
-        return (retval);
+        return retval;
     }
 
     size_t printCenter(uint16_t x, uint16_t y, uint16_t color, const char *format, ...)
     {
-        char buf[128];
+        setTextColor(color);
         va_list args;
         va_start(args, format);
-        setTextColor(color);
-        vsnprintf(buf, 127, format, args);
+        size_t retval = printText(TextAlign::CENTER, x, y, format, args);
         va_end(args);
-        int16_t x1, y1;
-        uint16_t w, h;
-        const String text = buf;
-        getTextBounds(text, 0, 12, &x1, &y1, &w, &h);
-        setCursor(x - (w / 2), y);
-        size_t retval = print(buf);
-        return (retval);
+        return retval;
+    }
+
+    // Text that owns an area of the screen, like the timer line. If the same text,
+    // colour, font and alignment are already showing there it returns 0 having drawn
+    // nothing. Otherwise the area is cleared to the background and the text drawn.
+    // Anything else drawn over the area in between means it gets redrawn.
+    size_t printIn(const TextArea &area, TextAlign align, int16_t x, int16_t y, uint16_t color, const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(_textArena, sizeof(_textArena), format, args);
+        va_end(args);
+        if (len < 0)
+            return 0;
+        if (len >= (int)sizeof(_textArena))
+            len = sizeof(_textArena) - 1;
+
+        TextAreaCache &cache = areaCache(area);
+        if (cache.valid && cache.align == align && cache.x == x && cache.y == y && cache.color == color &&
+            cache.font == gfxFont && cache.len == len && !memcmp(cache.text, _textArena, len))
+        {
+            _textStats.skipped++;
+            return 0;
+        }
+
+        fillRect(area.x, area.y, area.w, area.h, _textBackground);
+        setTextColor(color);
+        placeText(align, x, y, _textArena);
+        write((const uint8_t *)_textArena, len);
+        _textStats.drawn++;
+
+        // Drawing it marked the area stale; it's current now, if it fits the cache.
+        cache.valid = len < (int)sizeof(cache.text);
+        cache.align = align;
+        cache.x = x;
+        cache.y = y;
+        cache.color = color;
+        cache.font = gfxFont;
+        cache.len = len;
+        if (cache.valid)
+            memcpy(cache.text, _textArena, len);
+        return len;
+    }
+
+    void setTextBackground(uint16_t color) { _textBackground = color; }
+    const TextStats &textStats() const { return _textStats; }
+
+    // Fixed strings measured at compile time, see TextMetrics.h. The text must be in
+    // the font that's current when it's printed.
+    size_t printRight(uint16_t x, uint16_t y, uint16_t color, const MeasuredText &text)
+    {
+        setTextColor(color);
+        setCursor(x - text.bounds.w, y);
+        return print(text.text);
+    }
+
+    size_t printCenter(uint16_t x, uint16_t y, uint16_t color, const MeasuredText &text)
+    {
+        setTextColor(color);
+        setCursor(x - text.bounds.w / 2, y);
+        return print(text.text);
     }
 
     // All of a sudden this became necessary. https://github.com/mrfaptastic/ESP32-HUB75-MatrixPanel-DMA/issues/20
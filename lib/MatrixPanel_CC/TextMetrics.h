@@ -0,0 +1,87 @@
+#ifndef CC_TextMetrics_h
+#define CC_TextMetrics_h
+
+#include <Adafruit_GFX.h>
+
+// Text measurement straight off a GFXfont's glyph table. It's constexpr, so fixed
+// strings get measured by the compiler, and it's the same code at run time, with no
+// String and no heap.
+//
+// The GFXfont struct itself holds non-const pointers, so it can't be read at compile
+// time. FontMetrics points at the glyph table directly; each font header defines one.
+
+struct TextBounds
+{
+    int16_t x1;
+    int16_t y1;
+    uint16_t w;
+    uint16_t h;
+};
+
+struct FontMetrics
+{
+    const GFXglyph *glyphs;
+    uint8_t first;
+    uint8_t last;
+    uint8_t yAdvance;
+};
+
+// What Adafruit_GFX::getTextBounds() gives with wrapping off: the box around every
+// glyph, spaces included, with the cursor starting at (x, y).
+constexpr TextBounds measureText(const FontMetrics &font, const char *text, int16_t x = 0, int16_t y = 0)
+{
+    int16_t startX = x, startY = y;
+    int16_t minx = 0x7FFF, miny = 0x7FFF, maxx = -1, maxy = -1;
+    for (; *text; text++)
+    {
+        uint8_t c = *text;
+        if (c == '\n')
+        {
+            x = 0;
+            y += font.yAdvance;
+            continue;
+        }
+        if (c < font.first || c > font.last)
+            continue;
+        const GFXglyph &g = font.glyphs[c - font.first];
+        int16_t x1 = x + g.xOffset, y1 = y + g.yOffset;
+        int16_t x2 = x1 + g.width - 1, y2 = y1 + g.height - 1;
+        if (x1 < minx)
+            minx = x1;
+        if (y1 < miny)
+            miny = y1;
+        if (x2 > maxx)
+            maxx = x2;
+        if (y2 > maxy)
+            maxy = y2;
+        x += g.xAdvance;
+    }
+
+    TextBounds b = {startX, startY, 0, 0};
+    if (maxx >= minx)
+    {
+        b.x1 = minx;
+        b.w = maxx - minx + 1;
+    }
+    if (maxy >= miny)
+    {
+        b.y1 = miny;
+        b.h = maxy - miny + 1;
+    }
+    return b;
+}
+
+// A string measured once, normally at compile time:
+//   constexpr MeasuredText hot = measured(Impact12CapsMetrics, "HOT");
+struct MeasuredText
+{
+    const char *text;
+    TextBounds bounds;
+};
+
+constexpr MeasuredText measured(const FontMetrics &font, const char *text)
+{
+    return {text, measureText(font, text)};
+}
+
+#endif
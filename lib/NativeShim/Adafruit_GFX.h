@@ -0,0 +1,225 @@
+#ifndef NativeShim_Adafruit_GFX_h
+#define NativeShim_Adafruit_GFX_h
+
+// Host stand-in for Adafruit_GFX. Only the parts MatrixPanel_CC uses: GFXfont
+// text (drawChar, write, getTextBounds) and the rectangle and line primitives,
+// following the library's own code so text lands on the same pixels. The built-in
+// 5x7 font isn't here; everything on the sign uses a GFXfont.
+
+#include "Arduino.h"
+
+typedef struct
+{
+    uint16_t bitmapOffset;
+    uint8_t width;
+    uint8_t height;
+    uint8_t xAdvance;
+    int8_t xOffset;
+    int8_t yOffset;
+} GFXglyph;
+
+typedef struct
+{
+    uint8_t *bitmap;
+    GFXglyph *glyph;
+    uint16_t first;
+    uint16_t last;
+    uint8_t yAdvance;
+} GFXfont;
+
+class Adafruit_GFX : public Print
+{
+public:
+    Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), _width(w), _height(h) {}
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+    virtual void startWrite() {}
+    virtual void writePixel(int16_t x, int16_t y, uint16_t color) { drawPixel(x, y, color); }
+    virtual void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) { fillRect(x, y, w, h, color); }
+    virtual void writeFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { drawFastVLine(x, y, h, color); }
+    virtual void writeFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { drawFastHLine(x, y, w, color); }
+    virtual void endWrite() {}
+
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+    {
+        for (int16_t i = 0; i < h; i++)
+            drawPixel(x, y + i, color);
+    }
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+    {
+        for (int16_t i = 0; i < w; i++)
+            drawPixel(x + i, y, color);
+    }
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+    {
+        for (int16_t i = x; i < x + w; i++)
+            drawFastVLine(i, y, h, color);
+    }
+    virtual void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+
+    void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t /* bg */, uint8_t size_x, uint8_t size_y)
+    {
+        if (!gfxFont)
+            return;
+        c -= (uint8_t)pgm_read_byte(&gfxFont->first);
+        const GFXglyph *glyph = &gfxFont->glyph[c];
+        const uint8_t *bitmap = gfxFont->bitmap;
+        uint16_t bo = pgm_read_word(&glyph->bitmapOffset);
+        uint8_t w = pgm_read_byte(&glyph->width), h = pgm_read_byte(&glyph->height);
+        int8_t xo = pgm_read_byte(&glyph->xOffset), yo = pgm_read_byte(&glyph->yOffset);
+        uint8_t bits = 0, bit = 0;
+        int16_t xo16 = 0, yo16 = 0;
+        if (size_x > 1 || size_y > 1)
+        {
+            xo16 = xo;
+            yo16 = yo;
+        }
+        startWrite();
+        for (uint8_t yy = 0; yy < h; yy++)
+        {
+            for (uint8_t xx = 0; xx < w; xx++)
+            {
+                if (!(bit++ & 7))
+                    bits = pgm_read_byte(&bitmap[bo++]);
+                if (bits & 0x80)
+                {
+                    if (size_x == 1 && size_y == 1)
+                        writePixel(x + xo + xx, y + yo + yy, color);
+                    else
+                        writeFillRect(x + (xo16 + xx) * size_x, y + (yo16 + yy) * size_y, size_x, size_y, color);
+                }
+                bits <<= 1;
+            }
+        }
+        endWrite();
+    }
+
+    using Print::write;
+    virtual size_t write(uint8_t c)
+    {
+        if (!gfxFont)
+            return 1;
+        if (c == '\n')
+        {
+            cursor_x = 0;
+            cursor_y += (int16_t)textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+        }
+        else if (c != '\r')
+        {
+            uint8_t first = pgm_read_byte(&gfxFont->first);
+            if (c >= first && c <= (uint8_t)pgm_read_byte(&gfxFont->last))
+            {
+                const GFXglyph *glyph = &gfxFont->glyph[c - first];
+                uint8_t w = pgm_read_byte(&glyph->width), h = pgm_read_byte(&glyph->height);
+                if (w > 0 && h > 0)
+                {
+                    int16_t xo = (int8_t)pgm_read_byte(&glyph->xOffset);
+                    if (wrap && (cursor_x + textsize_x * (xo + w)) > _width)
+                    {
+                        cursor_x = 0;
+                        cursor_y += (int16_t)textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+                    }
+                    drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+                }
+                cursor_x += (uint8_t)pgm_read_byte(&glyph->xAdvance) * (int16_t)textsize_x;
+            }
+        }
+        return 1;
+    }
+
+    void getTextBounds(const char *str, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+    {
+        uint8_t c;
+        int16_t minx = 0x7FFF, miny = 0x7FFF, maxx = -1, maxy = -1;
+        *x1 = x;
+        *y1 = y;
+        *w = *h = 0;
+        while ((c = *str++))
+            charBounds(c, &x, &y, &minx, &miny, &maxx, &maxy);
+        if (maxx >= minx)
+        {
+            *x1 = minx;
+            *w = maxx - minx + 1;
+        }
+        if (maxy >= miny)
+        {
+            *y1 = miny;
+            *h = maxy - miny + 1;
+        }
+    }
+    void getTextBounds(const String &str, int16_t x, int16_t y, int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h)
+    {
+        getTextBounds(str.c_str(), x, y, x1, y1, w, h);
+    }
+
+    void setCursor(int16_t x, int16_t y)
+    {
+        cursor_x = x;
+        cursor_y = y;
+    }
+    void setTextColor(uint16_t c) { textcolor = textbgcolor = c; }
+    void setTextColor(uint16_t c, uint16_t bg)
+    {
+        textcolor = c;
+        textbgcolor = bg;
+    }
+    void setTextSize(uint8_t s) { textsize_x = textsize_y = s > 0 ? s : 1; }
+    void setTextWrap(bool w) { wrap = w; }
+    void setFont(const GFXfont *f) { gfxFont = (GFXfont *)f; }
+    void setRotation(uint8_t r) { rotation = r & 3; }
+    int16_t width() const { return _width; }
+    int16_t height() const { return _height; }
+    int16_t getCursorX() const { return cursor_x; }
+    int16_t getCursorY() const { return cursor_y; }
+
+protected:
+    void charBounds(unsigned char c, int16_t *x, int16_t *y, int16_t *minx, int16_t *miny, int16_t *maxx, int16_t *maxy)
+    {
+        if (!gfxFont)
+            return;
+        if (c == '\n')
+        {
+            *x = 0;
+            *y += textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+        }
+        else if (c != '\r')
+        {
+            uint8_t first = pgm_read_byte(&gfxFont->first), last = pgm_read_byte(&gfxFont->last);
+            if (c >= first && c <= last)
+            {
+                const GFXglyph *glyph = &gfxFont->glyph[c - first];
+                uint8_t gw = pgm_read_byte(&glyph->width), gh = pgm_read_byte(&glyph->height),
+                        xa = pgm_read_byte(&glyph->xAdvance);
+                int8_t xo = pgm_read_byte(&glyph->xOffset), yo = pgm_read_byte(&glyph->yOffset);
+                if (wrap && ((*x + (((int16_t)xo + gw) * textsize_x)) > _width))
+                {
+                    *x = 0;
+                    *y += textsize_y * (uint8_t)pgm_read_byte(&gfxFont->yAdvance);
+                }
+                int16_t tsx = (int16_t)textsize_x, tsy = (int16_t)textsize_y, x1 = *x + xo * tsx,
+                        y1 = *y + yo * tsy, x2 = x1 + gw * tsx - 1, y2 = y1 + gh * tsy - 1;
+                if (x1 < *minx)
+                    *minx = x1;
+                if (y1 < *miny)
+                    *miny = y1;
+                if (x2 > *maxx)
+                    *maxx = x2;
+                if (y2 > *maxy)
+                    *maxy = y2;
+                *x += xa * tsx;
+            }
+        }
+    }
+
+    const int16_t WIDTH, HEIGHT;
+    int16_t _width, _height;
+    int16_t cursor_x = 0, cursor_y = 0;
+    uint16_t textcolor = 0xFFFF, textbgcolor = 0xFFFF;
+    uint8_t textsize_x = 1, textsize_y = 1;
+    uint8_t rotation = 0;
+    bool wrap = true;
+    GFXfont *gfxFont = nullptr;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef NativeShim_Arduino_h
+#define NativeShim_Arduino_h
+
+// Host stand-in for the Arduino core. Only built for [env:native] (see library.json).
+// Time is virtual by default: millis() only moves when the driver calls
+// nativeAdvanceMillis(), so a 72 minute scenario runs as fast as the CPU can step it.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "HardwareSerial.h"
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_pointer(addr) (*(void *const *)(addr))
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+using std::max;
+using std::min;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+// The ESP32 core's NTP calls, on the host's own clock.
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char *server1, const char *server2 = nullptr,
+                const char *server3 = nullptr);
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+// Virtual clock control for host drivers.
+void nativeSetMillis(unsigned long ms);
+void nativeAdvanceMillis(unsigned long ms);
+// Drivers that talk to real sockets (the server test) need real time instead. The
+// virtual clock's count still adds on, so nativeAdvanceMillis() can put real time ahead.
+void nativeUseRealTime(bool enable);
+// CPU time used so far by the calling thread, and by the whole process.
+uint64_t nativeThreadCpuUs();
+uint64_t nativeProcessCpuUs();
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef NativeShim_HUB75_h
+#define NativeShim_HUB75_h
+
+// Host stand-in for the HUB75 DMA panel driver. The "DMA buffers" are plain
+// arrays, one or two depending on double_buff, and frontBuffer() is what the panel
+// would be showing. Host tools read it to see what a frame actually looks like.
+
+#include <vector>
+#include "Adafruit_GFX.h"
+
+struct HUB75_I2S_CFG
+{
+    struct i2s_pins
+    {
+        int8_t r1, g1, b1, r2, g2, b2, a, b, c, d, e, lat, oe, clk;
+    };
+
+    enum shift_driver
+    {
+        SHIFTREG = 0,
+        FM6124,
+        FM6126A,
+        ICN2038S,
+        MBI5124,
+        SM5266P
+    };
+
+    uint16_t mx_width;
+    uint16_t mx_height;
+    uint16_t chain_length;
+    i2s_pins gpio;
+    shift_driver driver;
+    bool double_buff;
+
+    HUB75_I2S_CFG(uint16_t _w = 64, uint16_t _h = 32, uint16_t _chain = 1, i2s_pins _pinmap = {},
+                  shift_driver _drv = SHIFTREG, bool _dbuff = false)
+        : mx_width(_w), mx_height(_h), chain_length(_chain), gpio(_pinmap), driver(_drv), double_buff(_dbuff)
+    {
+    }
+};
+
+class MatrixPanel_I2S_DMA : public Adafruit_GFX
+{
+private:
+    HUB75_I2S_CFG _cfg;
+    std::vector<uint16_t> _fb[2];
+    uint8_t _back = 0;
+    uint8_t _brightness = 128;
+    uint32_t _writes = 0;
+    uint32_t _flips = 0;
+
+    void put(int16_t x, int16_t y, uint16_t color)
+    {
+        if (x < 0 || y < 0 || x >= _width || y >= _height)
+            return;
+        _fb[_back][y * _width + x] = color;
+        _writes++;
+    }
+
+public:
+    MatrixPanel_I2S_DMA(const HUB75_I2S_CFG &opts)
+        : Adafruit_GFX(opts.mx_width * opts.chain_length, opts.mx_height), _cfg(opts)
+    {
+    }
+
+    bool begin()
+    {
+        for (int i = 0; i < (_cfg.double_buff ? 2 : 1); i++)
+            _fb[i].assign(_width * _height, 0);
+        _back = _cfg.double_buff ? 1 : 0;
+        return true;
+    }
+
+    virtual void drawPixel(int16_t x, int16_t y, uint16_t color) { put(x, y, color); }
+    virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+    {
+        for (int16_t i = 0; i < w; i++)
+            put(x + i, y, color);
+    }
+    virtual void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+    {
+        for (int16_t i = 0; i < h; i++)
+            put(x, y + i, color);
+    }
+    virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+    {
+        for (int16_t i = 0; i < h; i++)
+            drawFastHLine(x, y + i, w, color);
+    }
+    virtual void fillScreen(uint16_t color) { fillRect(0, 0, _width, _height, color); }
+
+    void flipDMABuffer()
+    {
+        if (!_cfg.double_buff)
+            return;
+        _back ^= 1;
+        _flips++;
+    }
+
+    void setBrightness8(uint8_t b) { _brightness = b; }
+    void setPanelBrightness(uint8_t b) { _brightness = b; }
+    void clearScreen() { fillScreen(0); }
+
+    static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) { return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3); }
+    static uint16_t color444(uint8_t r, uint8_t g, uint8_t b) { return color565(r * 17, g * 17, b * 17); }
+
+    // Host only.
+    const uint16_t *frontBuffer() const { return _fb[_cfg.double_buff ? _back ^ 1 : 0].data(); }
+    uint8_t brightness() const { return _brightness; }
+    uint32_t pixelWrites() const { return _writes; }
+    uint32_t flips() const { return _flips; }
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef NativeShim_HardwareSerial_h
+#define NativeShim_HardwareSerial_h
+
+#include <cstdio>
+#include "Print.h"
+
+// Serial goes to stdout by default. setOutput(nullptr) mutes it, which the replay
+// and bench drivers use so logging doesn't dominate the numbers.
+class HardwareSerial : public Print
+{
+private:
+    FILE *_out = stdout;
+
+public:
+    void begin(unsigned long) {}
+    void setOutput(FILE *out) { _out = out; }
+    operator bool() const { return true; }
+
+    using Print::write;
+    size_t write(uint8_t c) override
+    {
+        if (_out)
+            fputc(c, _out);
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        if (_out)
+            fwrite(buffer, 1, size, _out);
+        return size;
+    }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,182 @@
+#include <chrono>
+#include <ctime>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "freertos/task.h"
+
+HardwareSerial Serial;
+
+static unsigned long virtualMillis = 0;
+static bool realTime = false;
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+    if (realTime)
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() +
+               virtualMillis;
+    return virtualMillis;
+}
+
+unsigned long micros()
+{
+    if (realTime)
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count() +
+               virtualMillis * 1000UL;
+    return virtualMillis * 1000UL;
+}
+
+void delay(unsigned long ms)
+{
+    if (realTime)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    else
+        virtualMillis += ms;
+}
+
+void nativeUseRealTime(bool enable)
+{
+    realTime = enable;
+}
+
+void nativeSetMillis(unsigned long ms)
+{
+    virtualMillis = ms;
+}
+
+void nativeAdvanceMillis(unsigned long ms)
+{
+    virtualMillis += ms;
+}
+
+uint64_t nativeThreadCpuUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t nativeProcessCpuUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// The host's clock is already set, and its zone is whatever TZ says.
+void configTime(long, int, const char *, const char *, const char *)
+{
+}
+
+bool getLocalTime(struct tm *info, uint32_t)
+{
+    time_t now = time(nullptr);
+    if (now < 1600000000)
+        return false;
+    localtime_r(&now, info);
+    return true;
+}
+
+// FreeRTOS tasks, see freertos/task.h.
+
+struct NativeTask
+{
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+static std::vector<NativeTask *> tasks;
+static std::mutex tasksLock;
+static thread_local NativeTask *currentTask = nullptr;
+
+// Name, stack, priority and core mean nothing to a thread here.
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *, uint32_t, void *param, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+    NativeTask *task = new NativeTask;
+    task->thread = std::thread([task, code, param]
+                               {
+        currentTask = task;
+        code(param); });
+    std::lock_guard<std::mutex> lock(tasksLock);
+    tasks.push_back(task);
+    if (handle)
+        *handle = task;
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks)
+        std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+    else
+        std::this_thread::yield();
+}
+
+void vTaskDelete(TaskHandle_t)
+{
+    // Nothing to do. The caller returns, and that ends its thread.
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() /
+           portTICK_PERIOD_MS;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t)
+{
+    return 0;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->lock);
+        task->notifications++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    NativeTask *task = currentTask;
+    if (!task)
+        return 0;
+    std::unique_lock<std::mutex> lock(task->lock);
+    if (!task->notifications && ticksToWait)
+    {
+        auto ready = [task]
+        { return task->notifications > 0; };
+        if (ticksToWait == portMAX_DELAY)
+            task->notified.wait(lock, ready);
+        else
+            task->notified.wait_for(lock, std::chrono::milliseconds(ticksToWait * portTICK_PERIOD_MS), ready);
+    }
+    uint32_t count = task->notifications;
+    if (count)
+        task->notifications = clearOnExit ? 0 : count - 1;
+    return count;
+}
+
+void nativeJoinTasks()
+{
+    std::lock_guard<std::mutex> lock(tasksLock);
+    for (NativeTask *task : tasks)
+    {
+        task->thread.join();
+        delete task;
+    }
+    tasks.clear();
+}
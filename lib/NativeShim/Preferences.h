@@ -0,0 +1,51 @@
+#ifndef NativeShim_Preferences_h
+#define NativeShim_Preferences_h
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// NVS on the host: kept in memory, so it lasts as long as the process.
+class Preferences
+{
+    std::string _namespace;
+
+    static std::map<std::string, std::vector<uint8_t>> &store()
+    {
+        static std::map<std::string, std::vector<uint8_t>> s;
+        return s;
+    }
+    std::string path(const char *key) const { return _namespace + "/" + key; }
+
+public:
+    bool begin(const char *name, bool = false)
+    {
+        _namespace = name;
+        return true;
+    }
+    void end() {}
+
+    size_t getBytesLength(const char *key)
+    {
+        auto it = store().find(path(key));
+        return it == store().end() ? 0 : it->second.size();
+    }
+    size_t getBytes(const char *key, void *buf, size_t maxLen)
+    {
+        auto it = store().find(path(key));
+        if (it == store().end() || it->second.size() > maxLen)
+            return 0;
+        memcpy(buf, it->second.data(), it->second.size());
+        return it->second.size();
+    }
+    size_t putBytes(const char *key, const void *value, size_t len)
+    {
+        store()[path(key)].assign((const uint8_t *)value, (const uint8_t *)value + len);
+        return len;
+    }
+    bool remove(const char *key) { return store().erase(path(key)) > 0; }
+};
+
+#endif
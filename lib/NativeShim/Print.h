@@ -0,0 +1,82 @@
+#ifndef NativeShim_Print_h
+#define NativeShim_Print_h
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include "WString.h"
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+            n += write(*buffer++);
+        return n;
+    }
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char loc_buf[128];
+        char *temp = loc_buf;
+        va_list arg;
+        va_start(arg, format);
+        va_list copy;
+        va_copy(copy, arg);
+        int len = vsnprintf(temp, sizeof(loc_buf), format, copy);
+        va_end(copy);
+        if (len < 0)
+        {
+            va_end(arg);
+            return 0;
+        }
+        if (len >= (int)sizeof(loc_buf))
+        {
+            temp = new char[len + 1];
+            vsnprintf(temp, len + 1, format, arg);
+        }
+        va_end(arg);
+        len = write((const uint8_t *)temp, len);
+        if (temp != loc_buf)
+            delete[] temp;
+        return len;
+    }
+
+    size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+    size_t print(const char *s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return print(String(n)); }
+    size_t print(unsigned int n) { return print(String(n)); }
+    size_t print(long n) { return print(String(n)); }
+    size_t print(unsigned long n) { return print(String(n)); }
+    size_t print(unsigned long long n) { return print(String(n)); }
+    size_t print(double n, int digits = 2) { return print(String(n, (unsigned char)digits)); }
+    size_t print(const struct tm *timeinfo, const char *format = nullptr)
+    {
+        char buf[64];
+        size_t len = strftime(buf, sizeof(buf), format ? format : "%c", timeinfo);
+        return write((const uint8_t *)buf, len);
+    }
+
+    size_t println() { return write((uint8_t)'\n'); }
+    size_t println(const struct tm *timeinfo, const char *format = nullptr)
+    {
+        size_t n = print(timeinfo, format);
+        return n + println();
+    }
+    template <typename T>
+    size_t println(const T &v)
+    {
+        size_t n = print(v);
+        return n + println();
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef NativeShim_WString_h
+#define NativeShim_WString_h
+
+#include <string>
+#include <type_traits>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+// Minimal Arduino String for the host build. Only what the project actually uses.
+
+#define DEC 10
+#define HEX 16
+
+class String
+{
+private:
+    std::string _s;
+
+    template <typename T>
+    static std::string fmtInt(T value, unsigned char base)
+    {
+        char buf[34];
+        if (base == HEX)
+            snprintf(buf, sizeof(buf), "%llx", (unsigned long long)value);
+        else
+            snprintf(buf, sizeof(buf), std::is_signed<T>::value ? "%lld" : "%llu", (long long)value);
+        return buf;
+    }
+
+public:
+    String() {}
+    String(const char *s) : _s(s ? s : "") {}
+    String(const std::string &s) : _s(s) {}
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(int v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(unsigned int v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(long v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(unsigned long v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(long long v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(unsigned long long v, unsigned char base = DEC) : _s(fmtInt(v, base)) {}
+    explicit String(float v, unsigned char decimals = 2) : String((double)v, decimals) {}
+    explicit String(double v, unsigned char decimals = 2)
+    {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+        _s = buf;
+    }
+
+    const char *c_str() const { return _s.c_str(); }
+    unsigned int length() const { return _s.length(); }
+    char operator[](unsigned int i) const { return _s[i]; }
+
+    float toFloat() const { return strtof(_s.c_str(), nullptr); }
+    long toInt() const { return strtol(_s.c_str(), nullptr, 10); }
+
+    bool startsWith(const String &prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    String substring(unsigned int from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < _s.size() ? String(_s.substr(from, to - from)) : String(); }
+
+    String &operator+=(const String &rhs)
+    {
+        _s += rhs._s;
+        return *this;
+    }
+    String &operator+=(const char *rhs)
+    {
+        _s += rhs;
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        _s += c;
+        return *this;
+    }
+
+    friend String operator+(const String &lhs, const String &rhs) { return String(lhs._s + rhs._s); }
+    friend String operator+(const String &lhs, const char *rhs) { return String(lhs._s + rhs); }
+    friend String operator+(const char *lhs, const String &rhs) { return String(lhs + rhs._s); }
+
+    bool operator==(const String &rhs) const { return _s == rhs._s; }
+    bool operator==(const char *rhs) const { return _s == rhs; }
+    bool operator!=(const String &rhs) const { return _s != rhs._s; }
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef NativeShim_FreeRTOS_h
+#define NativeShim_FreeRTOS_h
+
+// Host stand-in for the FreeRTOS types the firmware uses. Ticks are milliseconds,
+// like the ESP32 Arduino core's 1000 Hz tick.
+
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NativeShim_task_h
+#define NativeShim_task_h
+
+// Host stand-in for FreeRTOS tasks, one std::thread each. Cores and priorities are
+// taken and ignored; the host scheduler decides. Delays are real time, whatever
+// nativeUseRealTime() says, since the threads really do run side by side.
+//
+// A FreeRTOS task must never return. On the host it may, once it's been told to
+// stop, and nativeJoinTasks() waits for all of them to do so.
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct NativeTask *TaskHandle_t;
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char *name, uint32_t stackDepth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+TickType_t xTaskGetTickCount();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+// Direct to task notifications, as a counting semaphore.
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+
+// Host only. Wait for every task started so far to return.
+void nativeJoinTasks();
+
+#endif
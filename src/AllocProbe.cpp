@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <new>
+#include "AllocProbe.hpp"
+
+#ifdef ARDUINO_ARCH_ESP32
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static volatile TaskHandle_t probeTask = nullptr;
+static volatile uint32_t probeCount = 0;
+
+static inline void countAlloc()
+{
+    if (probeTask && xTaskGetCurrentTaskHandle() == probeTask)
+        probeCount++;
+}
+
+extern "C"
+{
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t n, size_t size);
+    void *__real_realloc(void *ptr, size_t size);
+
+    void *__wrap_malloc(size_t size)
+    {
+        countAlloc();
+        return __real_malloc(size);
+    }
+    void *__wrap_calloc(size_t n, size_t size)
+    {
+        countAlloc();
+        return __real_calloc(n, size);
+    }
+    void *__wrap_realloc(void *ptr, size_t size)
+    {
+        countAlloc();
+        return __real_realloc(ptr, size);
+    }
+}
+
+void AllocProbe::begin()
+{
+    probeCount = 0;
+    probeTask = xTaskGetCurrentTaskHandle();
+}
+
+uint32_t AllocProbe::end()
+{
+    probeTask = nullptr;
+    return probeCount;
+}
+
+#else
+
+static thread_local bool probeActive = false;
+static thread_local uint32_t probeCount = 0;
+
+void *operator new(size_t size)
+{
+    if (probeActive)
+        probeCount++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void AllocProbe::begin()
+{
+    probeCount = 0;
+    probeActive = true;
+}
+
+uint32_t AllocProbe::end()
+{
+    probeActive = false;
+    return probeCount;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Counts heap allocations made by the calling task between begin() and end().
+// Used to prove the ingest handlers don't touch the heap.
+//
+// On the ESP32 malloc/calloc/realloc are wrapped at link time (see build_flags in
+// platformio.ini), which also catches String and operator new. On the host we
+// replace operator new, which is where the shim's String gets its memory.
+namespace AllocProbe
+{
+    void begin();
+    uint32_t end(); // Allocations since begin()
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// When the display may be on, as one bit per minute of the week. Asking is a single
+// bit test, where shouldDisplayBeOn() used to build a std::map of vectors on the heap
+// every call. The built-in schedule is compiled straight into the bitmap (see
+// SignTasks.cpp); /schedule replaces it at run time and it's kept in NVS.
+//
+// As text it's one span per line or comma, "days HH:MM-HH:MM":
+//   mon-thu 08:00-22:00, fri 08:00-19:00, sat 08:00-18:00, sun 12:00-18:00
+// Days are sun..sat or a range of them, which may wrap (fri-mon). The end is
+// exclusive and 24:00 means midnight. A span can't run past midnight; split it.
+// describe() writes the same form back, one line per day.
+
+#define SCHEDULE_DAY_MINUTES (24 * 60)
+#define SCHEDULE_WEEK_MINUTES (7 * SCHEDULE_DAY_MINUTES)
+#define SCHEDULE_WORDS ((SCHEDULE_WEEK_MINUTES + 31) / 32)
+
+// tm_wday numbering, 0 is Sunday.
+struct ScheduleSpan
+{
+    uint8_t day;
+    uint16_t startMinute; // Of the day
+    uint16_t endMinute;   // Exclusive, up to SCHEDULE_DAY_MINUTES
+};
+
+struct WeekSchedule
+{
+    uint32_t bits[SCHEDULE_WORDS];
+
+    constexpr void add(const ScheduleSpan &span)
+    {
+        uint32_t day = span.day * SCHEDULE_DAY_MINUTES;
+        for (uint32_t m = day + span.startMinute; m < day + span.endMinute; m++)
+            bits[m / 32] |= 1u << (m % 32);
+    }
+
+    constexpr bool on(uint32_t minuteOfWeek) const { return bits[minuteOfWeek / 32] >> (minuteOfWeek % 32) & 1; }
+    constexpr bool on(int day, int hour, int minute) const { return on(day * SCHEDULE_DAY_MINUTES + hour * 60 + minute); }
+
+    size_t describe(char *out, size_t size) const;
+};
+
+template <size_t N>
+constexpr WeekSchedule weekSchedule(const ScheduleSpan (&spans)[N])
+{
+    WeekSchedule schedule = {};
+    for (size_t i = 0; i < N; i++)
+        schedule.add(spans[i]);
+    return schedule;
+}
+
+static const char *const scheduleDayNames[7] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+namespace schedule_detail
+{
+inline const char *skipSpace(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+inline bool parseDay(const char *&s, uint8_t *day)
+{
+    for (uint8_t d = 0; d < 7; d++)
+    {
+        const char *name = scheduleDayNames[d];
+        if ((s[0] | 0x20) == name[0] && (s[1] | 0x20) == name[1] && (s[2] | 0x20) == name[2])
+        {
+            *day = d;
+            s += 3;
+            return true;
+        }
+    }
+    return false;
+}
+
+// HH:MM, H:MM or HH, up to 24:00.
+inline bool parseTime(const char *&s, uint16_t *minute)
+{
+    int hour = 0, digits = 0;
+    while (*s >= '0' && *s <= '9' && digits < 2)
+    {
+        hour = hour * 10 + (*s++ - '0');
+        digits++;
+    }
+    if (!digits)
+        return false;
+    int min = 0;
+    if (*s == ':')
+    {
+        s++;
+        if (s[0] < '0' || s[0] > '5' || s[1] < '0' || s[1] > '9')
+            return false;
+        min = (s[0] - '0') * 10 + (s[1] - '0');
+        s += 2;
+    }
+    if (hour > 24 || (hour == 24 && min))
+        return false;
+    *minute = hour * 60 + min;
+    return true;
+}
+} // namespace schedule_detail
+
+// Parses the text form into schedule. False, with schedule left as it was, on anything
+// it doesn't understand. An empty text is a schedule that's never on.
+inline bool parseSchedule(const char *text, WeekSchedule *schedule)
+{
+    using namespace schedule_detail;
+    WeekSchedule parsed = {};
+    const char *s = text;
+    for (;;)
+    {
+        while (*s == ' ' || *s == '\t' || *s == ',' || *s == ';' || *s == '\r' || *s == '\n')
+            s++;
+        if (!*s)
+            break;
+
+        uint8_t first, last;
+        if (!parseDay(s, &first))
+            return false;
+        last = first;
+        if (*s == '-' && !parseDay(++s, &last))
+            return false;
+        const char *times = skipSpace(s);
+        if (times == s)
+            return false;
+        s = times;
+
+        ScheduleSpan span = {0, 0, 0};
+        if (!parseTime(s, &span.startMinute) || *s++ != '-' || !parseTime(s, &span.endMinute))
+            return false;
+        if (span.endMinute <= span.startMinute)
+            return false;
+        s = skipSpace(s);
+        if (*s && *s != ',' && *s != ';' && *s != '\r' && *s != '\n')
+            return false;
+
+        for (uint8_t d = first;; d = (d + 1) % 7)
+        {
+            span.day = d;
+            parsed.add(span);
+            if (d == last)
+                break;
+        }
+    }
+    *schedule = parsed;
+    return true;
+}
+
+// The text form, one line per day that has any time on, each span as it stands in
+// the bitmap. Returns the length, truncated to fit like snprintf's output.
+inline size_t WeekSchedule::describe(char *out, size_t size) const
+{
+    size_t len = 0;
+    if (size)
+        out[0] = 0;
+    for (int day = 0; day < 7; day++)
+    {
+        bool any = false;
+        for (int m = 0; m < SCHEDULE_DAY_MINUTES; m++)
+        {
+            if (!on(day * SCHEDULE_DAY_MINUTES + m))
+                continue;
+            int end = m;
+            while (end < SCHEDULE_DAY_MINUTES && on(day * SCHEDULE_DAY_MINUTES + end))
+                end++;
+            if (len < size)
+                len += snprintf(out + len, size - len, "%s%s %02d:%02d-%02d:%02d", any ? ", " : "", scheduleDayNames[day],
+                                m / 60, m % 60, end / 60, end % 60);
+            any = true;
+            m = end;
+        }
+        if (any && len < size)
+            len += snprintf(out + len, size - len, "\n");
+    }
+    return len < size ? len : (size ? size - 1 : 0);
+}
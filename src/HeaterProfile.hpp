@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+// How long the heater takes to do things, and what it draws doing them. These used to
+// be #defines switched by HOME_TESTING; now each set is a constexpr object and the
+// monitor is compiled against one (BasicHeaterMonitor's second template argument), so
+// a host replay can run either without rebuilding the other.
+//
+// Building with -DHOME_TESTING picks homeTestingProfile as the default, as it always
+// did. -DHEATER_PROFILE=<name> picks any other.
+
+struct HeaterProfile
+{
+    uint32_t startupTimeoutMs; // It's hard to tell what's going on at startup, but if no power assume off
+    uint32_t warmToHotMs;
+    uint32_t hotToWarmMs;
+    uint32_t warmToCoolMs;
+    uint32_t coolToOffMs;
+    uint32_t lostConnectionMs; // No plug update for this long. Normal is 1 per sec.
+
+    // LOWER bounds of current readings. double, like the #defines were, so readings
+    // compare exactly as they always have.
+    double offCurrentA;
+    double heatingCurrentA;     // Over this is warming
+    double maintainingCurrentA; // Over this and under heating is maintaining
+
+    // The state machine relies on the currents being in this order.
+    constexpr bool valid() const
+    {
+        return offCurrentA < maintainingCurrentA && maintainingCurrentA < heatingCurrentA;
+    }
+};
+
+// The heater as installed.
+inline constexpr HeaterProfile fieldProfile = {
+    20 * 1000,      // 20 seconds
+    100 * 1000,     // 100 seconds. Measured.
+    72 * 60 * 1000, // 72 minutes. Takes a long time!
+    30 * 60 * 1000, // 30 minutes. Estimation. Need to measure.
+    15 * 60 * 1000, // 15 minutes
+    10 * 1000,      // 10 seconds
+    0.0,
+    12.0, // I think it's around 12.4
+    0.05, // I think it's around 7.6
+};
+
+// A lamp on the plug at home, with everything sped up.
+inline constexpr HeaterProfile homeTestingProfile = {
+    20 * 1000,      // 20 seconds
+    10 * 1000,      // 10 seconds
+    60 * 1000,      // 1 minute
+    30 * 1000,      // 30 seconds
+    15 * 60 * 1000, // 15 minutes
+    10 * 1000,      // 10 seconds
+    0.0,
+    .33,
+    .10,
+};
+
+static_assert(fieldProfile.valid() && homeTestingProfile.valid(), "Profile currents out of order");
+
+#ifndef HEATER_PROFILE
+#ifdef HOME_TESTING
+#define HEATER_PROFILE homeTestingProfile
+#else
+#define HEATER_PROFILE fieldProfile
+#endif
+#endif
@@ -1,41 +1,11 @@
-#include <Arduino.h>
-
-// #define HOME_TESTING 0
-
-#ifdef HOME_TESTING
-
-#define STARTUP_TIMEOUT_MS 20 * 1000   // 20 seconds  It's hard to tell what's going on at startup, but if no power assume cool
-#define OFF_TO_WARM_MS 0 * 1000        // 0 seconds
-#define WARM_TO_HOT_MS 10 * 1000      // 10 seconds. 
-#define HOT_TO_WARM_MS  60 * 1000  // 1 minutes. Takes a long time!
-#define WARM_TO_COOL_MS 30  * 1000 // 30 sec. Estimation. NEed to measure.
-#define COOL_TO_OFF_MS 15 * 60 * 1000  // 15 minutes
-#define LOST_CONNECTION_MS 10 * 1000   // 10 seconds  We haven't gotten a plug update in 10 seconds. Normal is 1 per sec
-
-// LOWER bounds of current readings for each state
-#define OFF_CURRENT_A 0.0
-#define IDLE_CURRENT_A 0.15
-#define HEATING_CURRENT_A .33    // I think it's around 12.4, so over this and under HOT is warming.
-#define MAINTAINING_CURRENT_A .10 // I think it's around 7.6, so over this and under WARMING is maintaining.
+#pragma once
 
-#else
-
-#define STARTUP_TIMEOUT_MS 20 * 1000   // 20 seconds  It's hard to tell what's going on at startup, but if no power assume cool
-#define OFF_TO_WARM_MS 0 * 1000        // 0 seconds
-#define WARM_TO_HOT_MS 100 * 1000      // 100 seconds. Measured.
-#define HOT_TO_WARM_MS 72 * 60 * 1000  // 72 minutes. Takes a long time!
-#define WARM_TO_COOL_MS 30 * 60 * 1000 // 30 minutes. Estimation. NEed to measure.
-#define COOL_TO_OFF_MS 15 * 60 * 1000  // 15 minutes
-#define LOST_CONNECTION_MS 10 * 1000   // 10 seconds  We haven't gotten a plug update in 10 seconds. Normal is 1 per sec
-
-// LOWER bounds of current readings for each state
-#define OFF_CURRENT_A 0.0
-#define HEATING_CURRENT_A 12.0    // I think it's around 12.4, so over this and under HOT is warming.
-#define MAINTAINING_CURRENT_A 0.05 // I think it's around 7.6, so over this and under WARMING is maintaining.
-
-#endif
+#include <Arduino.h>
+#include "HeaterProfile.hpp"
+#include "MonotonicClock.hpp"
+#include "SampleQueue.hpp"
 
-enum class HeaterTrend
+enum class HeaterTrend : uint8_t
 {
     HEATING,
     COOLING,
@@ -45,7 +15,7 @@ enum class HeaterTrend
     STARTUP
 };
 
-enum class HeaterState
+enum class HeaterState : uint8_t
 {
     STARTUP,
     COOL,
@@ -55,141 +25,251 @@ enum class HeaterState
     UNKNOWN
 };
 
+// For logs and /metrics, in enum order.
+static const char *const heaterTrendNames[] = {"HEATING", "COOLING", "MAINTAINING", "IDLE", "UNKNOWN", "STARTUP"};
+static const char *const heaterStateNames[] = {"STARTUP", "COOL", "OFF", "WARM", "HOT", "UNKNOWN"};
+
+// What the display needs from the monitor, copied out in one go so another task
+// can have it. Plain data, see Seqlock.hpp.
+struct HeaterSnapshot
+{
+    HeaterState state;
+    HeaterTrend trend;
+    uint64_t stateSinceMs; // Clock time of the last state change
+    uint64_t trendSinceMs; // ...and trend change
+};
+
+// One heater's state machine fields, by reference, so the same update() runs on a
+// BasicHeaterMonitor's own members or on a row of PlugTable's columns.
+struct HeaterFields
+{
+    HeaterState &state;
+    HeaterTrend &trend;
+    uint64_t &stateSinceMs;
+    uint64_t &trendSinceMs;
+    bool &unknown;
+};
+
+#define HEATER_STATES 6
+#define HEATER_BANDS 5
+
+// Where a reading falls against the profile's currents, as a bit for the rules below.
+// The state machine only ever looks at a reading through this.
+#define HEATER_NO_CURRENT (1 << 0)   // Up to offCurrentA
+#define HEATER_TRICKLE (1 << 1)      // Some, but under maintainingCurrentA
+#define HEATER_MAINTAINING (1 << 2)  // Under heatingCurrentA
+#define HEATER_AT_HEATING (1 << 3)   // Exactly heatingCurrentA. Trends as heating, but OFF or COOL go to HOT, not WARM.
+#define HEATER_OVER_HEATING (1 << 4) // Over it
+#define HEATER_UNDER_MAINTAINING (HEATER_NO_CURRENT | HEATER_TRICKLE) // Trend COOLING, or IDLE from OFF or COOL
+#define HEATER_HEATING (HEATER_AT_HEATING | HEATER_OVER_HEATING)      // Trend HEATING
+#define HEATER_SOME_CURRENT (HEATER_TRICKLE | HEATER_MAINTAINING | HEATER_HEATING)
+#define HEATER_ANY_READING (HEATER_NO_CURRENT | HEATER_SOME_CURRENT)
+
+// Rule flags
+#define HEATER_STAMP_NOW 1  // The new state starts at Clock::nowMs(), not the reading's time
+#define HEATER_UNEXPECTED 2 // Log it, this shouldn't happen
+
+// Which of the profile's times a state has to have lasted before a rule applies.
+enum class HeaterTimeout : uint8_t
+{
+    NONE, // Straight away
+    STARTUP,
+    WARM_TO_HOT,
+    HOT_TO_WARM,
+    WARM_TO_COOL,
+    COOL_TO_OFF
+};
+
+// In from, on a reading in one of readings, once from has lasted longer than after: to.
+struct HeaterRule
+{
+    HeaterState from;
+    uint8_t readings;
+    HeaterTimeout after;
+    HeaterState to;
+    uint8_t flags;
+};
+
+// The state machine. Anything not here stays as it is. A state with no readings for
+// the profile's lostConnectionMs goes to UNKNOWN before any of this is looked at.
+static constexpr HeaterRule heaterRules[] = {
+    // If you see any current during startup, go to hot. Else if nothing for a while, off.
+    {HeaterState::STARTUP, HEATER_SOME_CURRENT, HeaterTimeout::NONE, HeaterState::HOT, 0},
+    {HeaterState::STARTUP, HEATER_NO_CURRENT, HeaterTimeout::STARTUP, HeaterState::OFF, HEATER_STAMP_NOW},
+    // If it's off or cool and we see power, go to warming. Maintaining theoretically shouldn't happen.
+    {HeaterState::OFF, HEATER_OVER_HEATING, HeaterTimeout::NONE, HeaterState::WARM, 0},
+    {HeaterState::OFF, HEATER_MAINTAINING | HEATER_AT_HEATING, HeaterTimeout::NONE, HeaterState::HOT, HEATER_UNEXPECTED},
+    {HeaterState::COOL, HEATER_OVER_HEATING, HeaterTimeout::NONE, HeaterState::WARM, 0},
+    {HeaterState::COOL, HEATER_MAINTAINING | HEATER_AT_HEATING, HeaterTimeout::NONE, HeaterState::HOT, HEATER_UNEXPECTED},
+    // Eventually off if it's been cool for a while.
+    {HeaterState::COOL, HEATER_UNDER_MAINTAINING, HeaterTimeout::COOL_TO_OFF, HeaterState::OFF, 0},
+    // Warming and it's maintaining: hot, but should have already been there. Warming for
+    // long enough: hot too. So if it's turned on accidentally and immediately turned
+    // off, it will incorrectly go to hot.
+    {HeaterState::WARM, HEATER_MAINTAINING, HeaterTimeout::NONE, HeaterState::HOT, 0},
+    {HeaterState::WARM, HEATER_HEATING, HeaterTimeout::WARM_TO_HOT, HeaterState::HOT, 0},
+    {HeaterState::WARM, HEATER_UNDER_MAINTAINING, HeaterTimeout::WARM_TO_COOL, HeaterState::COOL, 0},
+    {HeaterState::HOT, HEATER_UNDER_MAINTAINING, HeaterTimeout::HOT_TO_WARM, HeaterState::WARM, 0},
+    // Readings again: back to startup.
+    {HeaterState::UNKNOWN, HEATER_ANY_READING, HeaterTimeout::NONE, HeaterState::STARTUP, 0},
+};
+
+// The trend a reading gives, by band, and whether the last state was COOL or OFF.
+static constexpr HeaterTrend heaterBandTrends[HEATER_BANDS][2] = {
+    {HeaterTrend::COOLING, HeaterTrend::IDLE},
+    {HeaterTrend::COOLING, HeaterTrend::IDLE},
+    {HeaterTrend::MAINTAINING, HeaterTrend::MAINTAINING},
+    {HeaterTrend::HEATING, HeaterTrend::HEATING},
+    {HeaterTrend::HEATING, HeaterTrend::HEATING},
+};
+
+// One cell of the compiled rules: what a reading in some band does to some state.
+struct HeaterStep
+{
+    HeaterTrend trend;
+    HeaterState to; // The same state when there's nothing to do
+    HeaterTimeout after;
+    uint8_t flags;
+};
+
+// The rules as a [state][band] table, trend included, so update() is one lookup
+// instead of a walk down the cases.
+struct HeaterSteps
+{
+    HeaterStep step[HEATER_STATES][HEATER_BANDS];
+};
+
+template <size_t N>
+constexpr HeaterSteps heaterSteps(const HeaterRule (&rules)[N])
+{
+    HeaterSteps steps = {};
+    for (uint8_t s = 0; s < HEATER_STATES; s++)
+        for (uint8_t b = 0; b < HEATER_BANDS; b++)
+            steps.step[s][b] = {heaterBandTrends[b][s == (uint8_t)HeaterState::COOL || s == (uint8_t)HeaterState::OFF],
+                                (HeaterState)s, HeaterTimeout::NONE, 0};
+    for (size_t i = 0; i < N; i++)
+        for (uint8_t b = 0; b < HEATER_BANDS; b++)
+        {
+            HeaterStep &step = steps.step[(uint8_t)rules[i].from][b];
+            if (rules[i].readings >> b & 1)
+                step = {step.trend, rules[i].to, rules[i].after, rules[i].flags};
+        }
+    return steps;
+}
+
+// Two rules for the same state and reading would be settled by whichever came last.
+template <size_t N>
+constexpr bool heaterRulesOverlap(const HeaterRule (&rules)[N])
+{
+    for (size_t i = 0; i < N; i++)
+        for (size_t j = i + 1; j < N; j++)
+            if (rules[i].from == rules[j].from && (rules[i].readings & rules[j].readings))
+                return true;
+    return false;
+}
+
+static_assert(!heaterRulesOverlap(heaterRules), "Two heater rules cover the same state and reading");
 
-class HeaterMonitor
+inline constexpr HeaterSteps heaterStepTable = heaterSteps(heaterRules);
+
+// Clock is anything with a static uint64_t nowMs(), see MonotonicClock.hpp.
+// The firmware uses SystemClock; simulations use VirtualClock to fast-forward.
+// Profile is the heater's times and currents, see HeaterProfile.hpp.
+template <typename Clock, const HeaterProfile &Profile = HEATER_PROFILE>
+class BasicHeaterMonitor
 {
 private:
+    // How long each HeaterTimeout needs, plus one: a state has to have lasted longer
+    // than its timeout, and NONE's 0 always passes.
+    static constexpr uint64_t minElapsedMs[] = {0,
+                                                Profile.startupTimeoutMs + 1ull,
+                                                Profile.warmToHotMs + 1ull,
+                                                Profile.hotToWarmMs + 1ull,
+                                                Profile.warmToCoolMs + 1ull,
+                                                Profile.coolToOffMs + 1ull};
+
     HeaterState _currentState;
     HeaterTrend _heaterTrend;
-    unsigned long lastStateChangeTime;
-    unsigned long lastTrendChangeTime;
+    uint64_t lastStateChangeTime;
+    uint64_t lastTrendChangeTime;
     float lastPowerReading;
     bool unknownFlag;
 
 public:
-    HeaterMonitor() : _currentState(HeaterState::STARTUP), lastStateChangeTime(0), lastPowerReading(0), unknownFlag(false)
+    BasicHeaterMonitor() : _currentState(HeaterState::STARTUP), lastStateChangeTime(0), lastTrendChangeTime(0), lastPowerReading(0), unknownFlag(false)
     {
         _heaterTrend = HeaterTrend::UNKNOWN;
     }
 
     long secondsSinceLastStateChange()
     {
-        return (millis() - lastStateChangeTime) / 1000;
+        return (Clock::nowMs() - lastStateChangeTime) / 1000;
     }
 
     long secondsSinceLastTrendChange()
     {
-        return (millis() - lastTrendChangeTime) / 1000;
+        return (Clock::nowMs() - lastTrendChangeTime) / 1000;
     }
 
     // powerReading is the raw reading from the current monitor.
-    // updateTime is the time the reading was last sent from the monitor
-    void update(float powerReading, unsigned long updateTime)
+    // updateTime is the Clock time the reading was last sent from the monitor
+    void update(float powerReading, uint64_t updateTime)
+    {
+        update({_currentState, _heaterTrend, lastStateChangeTime, lastTrendChangeTime, unknownFlag}, powerReading, updateTime);
+    }
+
+    // The same on fields kept somewhere else.
+    static void update(const HeaterFields &h, float powerReading, uint64_t updateTime)
     {
         // Check for unknown state. Set values and return if unknown.
-        if (millis() - updateTime > LOST_CONNECTION_MS)
+        if (Clock::nowMs() - updateTime > Profile.lostConnectionMs)
         {
-            setState(HeaterState::UNKNOWN, updateTime);
-            setTrend(HeaterTrend::UNKNOWN);
-            unknownFlag = true;
+            setState(h, HeaterState::UNKNOWN, updateTime);
+            setTrend(h, HeaterTrend::UNKNOWN);
+            h.unknown = true;
             return;
         }
-        else
-        {
-            unknownFlag = false;
-        }
+        h.unknown = false;
 
-        // Set the trend: heating, cooling, maintaining, or idle.
-        if (powerReading >= HEATING_CURRENT_A)
-        {
-            setTrend(HeaterTrend::HEATING);
-        }
-        else if (powerReading >= MAINTAINING_CURRENT_A)
-        {
-            setTrend(HeaterTrend::MAINTAINING);
-        }
-        else
-        {
-            if (getState() == HeaterState::COOL || getState() == HeaterState::OFF)  // Note that this will be the state in the last loop.
-                setTrend(HeaterTrend::IDLE);
-            else
-                setTrend(HeaterTrend::COOLING);
-        }
+        uint8_t band = currentBand(powerReading);
+        const HeaterStep &step = heaterStepTable.step[(uint8_t)h.state][band];
+
+        // Note the trend goes by the state in the last loop.
+        setTrend(h, step.trend);
 
-        // State machine logic
-        switch (_currentState)
+        if (step.to != h.state && updateTime - h.stateSinceMs >= minElapsedMs[(uint8_t)step.after])
         {
-        // If you see power during startup, go to hot. Else if nothing for (hysteresis time) go to cool.
-        case HeaterState::STARTUP:
-            if (powerReading > OFF_CURRENT_A) // If you see any current during startup, go to hot.
-            {
-                setState(HeaterState::HOT, updateTime);
-            }
-            else if (updateTime - lastStateChangeTime > STARTUP_TIMEOUT_MS)
-            {
-                setState(HeaterState::OFF);
-            }
-            break;
-        // If it's currently cool, and we see power, go to warming. If it stays off for x seconds, dim the display
-        case HeaterState::OFF:
-            // Fall through.
-        case HeaterState::COOL:
-            if (powerReading > HEATING_CURRENT_A)
-            {
-                setState(HeaterState::WARM, updateTime);
-            }
-            else if (powerReading >= MAINTAINING_CURRENT_A) // Theoretically should not see this.
-            {
-                setState(HeaterState::HOT, updateTime);
-                Serial.printf("Unexpected power reading in state %d: %f\n", (int)_currentState, powerReading);
-            }
-            else if (powerReading < MAINTAINING_CURRENT_A)
-            {
-                if (updateTime - lastStateChangeTime > COOL_TO_OFF_MS) // Eventually set state to off if it's been cool for a while.
-                {
-                    setState(HeaterState::OFF, updateTime);
-                }
-                break;
-            // If it's warming and it goes off, assume hot. If it's been warming for 2 minutes, go to hot.
-            // This could mean if it's turned on accidentally and immediately turned off, it will incorrectly go to hot.
-            case HeaterState::WARM:
-                if (getTrend() == HeaterTrend::MAINTAINING)  // Heater is maintaining...hot, but should have already been there.
-                {
-                    setState(HeaterState::HOT, updateTime);
-                }
-                else if (getTrend() == HeaterTrend::HEATING && updateTime - lastStateChangeTime > WARM_TO_HOT_MS)
-                {
-                    setState(HeaterState::HOT, updateTime);
-                }
-                else if (getTrend() == HeaterTrend::COOLING && updateTime - lastStateChangeTime > WARM_TO_COOL_MS)
-                {
-                    setState(HeaterState::COOL, updateTime);
-                }
-                break;
-
-            case HeaterState::HOT:
-                if (getTrend() == HeaterTrend::COOLING && updateTime - lastStateChangeTime > HOT_TO_WARM_MS)
-                {
-                    setState(HeaterState::WARM, updateTime);
-                }
-                break;
-
-            case HeaterState::UNKNOWN:
-                if (!unknownFlag)
-                {
-                    // Transition back to startup State
-                    setState(HeaterState::STARTUP, updateTime);
-                }
-                break;
-            }
-            // Check for unknown state after state machine logic
-            if (unknownFlag && _currentState != HeaterState::UNKNOWN)
-            {
-                setState(HeaterState::UNKNOWN, updateTime);
-            }
+            setState(h, step.to, step.flags & HEATER_STAMP_NOW ? Clock::nowMs() : updateTime);
+            if (step.flags & HEATER_UNEXPECTED)
+                Serial.printf("Unexpected power reading in state %d: %f\n", (int)h.state, powerReading);
         }
     }
 
+    // Which of the HEATER_* bands a reading is in, as a bit number. Compared as double,
+    // as the #defines used to be.
+    static uint8_t currentBand(float powerReading)
+    {
+        double a = powerReading;
+        return (a > Profile.offCurrentA) + (a >= Profile.maintainingCurrentA) + (a >= Profile.heatingCurrentA) +
+               (a > Profile.heatingCurrentA);
+    }
+
+    // Every reading waiting in queue, oldest first, each at the time it arrived. At
+    // most max of them, so a flood can't hold up the rest of the loop. Returns how many.
+    // changedBy, if given, gets the last reading that changed the state or trend, and
+    // is left alone if none did.
+    template <typename Queue>
+    uint32_t drain(Queue &queue, uint32_t max, Sample *changedBy = nullptr)
+    {
+        return queue.drain([this, changedBy](const Sample &sample)
+                           {
+            HeaterState state = _currentState;
+            HeaterTrend trend = _heaterTrend;
+            update(sample.milliamps / 1000.0f, sample.ms);
+            if (changedBy && (state != _currentState || trend != _heaterTrend))
+                *changedBy = sample; }, max);
+    }
+
     HeaterState getState() const
     {
         return _currentState;
@@ -200,10 +280,20 @@ public:
         return _heaterTrend;
     }
 
+    HeaterSnapshot snapshot() const
+    {
+        return {_currentState, _heaterTrend, lastStateChangeTime, lastTrendChangeTime};
+    }
+
     String updateSignage()
     {
-        // Implement your signage update logic here
-        switch (_currentState)
+        return signage(_currentState);
+    }
+
+private:
+    static const char *signage(HeaterState state)
+    {
+        switch (state)
         {
         case HeaterState::STARTUP:
             return "Signage: Starting up";
@@ -211,6 +301,9 @@ public:
         case HeaterState::COOL:
             return "Signage: Cool";
             break;
+        case HeaterState::OFF:
+            return "Signage: Off";
+            break;
         case HeaterState::WARM:
             return "Signage: Warming";
             break;
@@ -224,23 +317,24 @@ public:
         return "Signage: Unknown";
     }
 
-private:
-    void setState(HeaterState newState, unsigned long updateTime = millis())
+    static void setState(const HeaterFields &h, HeaterState newState, uint64_t updateTime)
     {
-        if (newState != _currentState)
+        if (newState != h.state)
         {
-            _currentState = newState;
-            lastStateChangeTime = updateTime;
-            Serial.println(updateSignage() + " @ " + String(lastStateChangeTime));
+            h.state = newState;
+            h.stateSinceMs = updateTime;
+            Serial.printf("%s @ %llu\n", signage(newState), (unsigned long long)updateTime);
         }
     }
-    void setTrend(HeaterTrend newTrend)
+    static void setTrend(const HeaterFields &h, HeaterTrend newTrend)
     {
-        if (newTrend != _heaterTrend)
+        if (newTrend != h.trend)
         {
-            lastTrendChangeTime = millis();
-            _heaterTrend = newTrend;
-            Serial.println("Trend: " + String((int)_heaterTrend) + " @ " + String(lastTrendChangeTime));
+            h.trendSinceMs = Clock::nowMs();
+            h.trend = newTrend;
+            Serial.printf("Trend: %d @ %llu\n", (int)newTrend, (unsigned long long)h.trendSinceMs);
         }
     }
-};
\ No newline at end of file
+};
+
+typedef BasicHeaterMonitor<SystemClock> HeaterMonitor;
\ No newline at end of file
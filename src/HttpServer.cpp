@@ -0,0 +1,654 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include "lwip/sockets.h"
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif
+
+#include "HttpServer.hpp"
+#include "AllocProbe.hpp"
+#include "MonotonicClock.hpp"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// %XX and '+' decoding, in place. The result is never longer than the input.
+static void urlDecode(char *s)
+{
+    char *out = s;
+    while (*s)
+    {
+        if (*s == '%' && hexValue(s[1]) >= 0 && hexValue(s[2]) >= 0)
+        {
+            *out++ = (char)(hexValue(s[1]) << 4 | hexValue(s[2]));
+            s += 3;
+        }
+        else if (*s == '+')
+        {
+            *out++ = ' ';
+            s++;
+        }
+        else
+            *out++ = *s++;
+    }
+    *out = 0;
+}
+
+static const char *methodName(HttpMethod method)
+{
+    switch (method)
+    {
+    case HttpMethod::GET:
+        return "GET";
+    case HttpMethod::POST:
+        return "POST";
+    case HttpMethod::PUT:
+        return "PUT";
+    case HttpMethod::DELETE:
+        return "DELETE";
+    default:
+        return "";
+    }
+}
+
+static const char *statusText(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+// Whether the buffer holds a whole request. Sets _headerLen to where it ends. A
+// request that fills the buffer without ending is taken as it is, and the
+// connection closed after it.
+bool HttpRequest::complete()
+{
+    _buf[_len] = 0;
+    _truncated = false;
+    const char *crlf = strstr(_buf, "\r\n\r\n");
+    const char *lf = strstr(_buf, "\n\n");
+    if (crlf && (!lf || crlf < lf))
+        _headerLen = crlf + 4 - _buf;
+    else if (lf)
+        _headerLen = lf + 2 - _buf;
+    else if (_len == HTTP_REQUEST_BUFFER)
+    {
+        _headerLen = _len;
+        _truncated = true;
+    }
+    else
+        return false;
+    return true;
+}
+
+// Split "GET /path?a=1&b=2 HTTP/1.1\r\n..." in place. Only the request line is
+// modified; a pipelined request after _headerLen is left alone.
+bool HttpRequest::parse()
+{
+    _args = 0;
+    _keepAlive = false;
+    _bodyLeft = 0;
+
+    char *end = _buf + _headerLen;
+    char *eol = (char *)memchr(_buf, '\n', _headerLen);
+    if (!eol)
+        return false;
+    *eol = 0;
+    if (eol > _buf && eol[-1] == '\r')
+        eol[-1] = 0;
+
+    char *target = strchr(_buf, ' ');
+    if (!target)
+        return false;
+    *target++ = 0;
+    char *version = strchr(target, ' ');
+    if (version)
+        *version++ = 0;
+    if (*target != '/')
+        return false;
+
+    // HTTP/1.1 is persistent unless it says close, 1.0 only if it asks. A chunked
+    // body can't be skipped without reading it, so that closes too.
+    if (!_truncated)
+    {
+        bool chunked = false;
+        _keepAlive = version && !strcmp(version, "HTTP/1.1");
+        for (char *line = eol + 1; line < end;)
+        {
+            char *next = (char *)memchr(line, '\n', end - line);
+            if (!next)
+                break;
+            if (!strncasecmp(line, "Connection:", 11))
+            {
+                const char *value = line + 11;
+                while (*value == ' ')
+                    value++;
+                if (!strncasecmp(value, "close", 5))
+                    _keepAlive = false;
+                else if (!strncasecmp(value, "keep-alive", 10))
+                    _keepAlive = true;
+            }
+            else if (!strncasecmp(line, "Content-Length:", 15))
+                _bodyLeft = strtoul(line + 15, nullptr, 10);
+            else if (!strncasecmp(line, "Transfer-Encoding:", 18))
+                chunked = true;
+            line = next + 1;
+        }
+        if (chunked)
+            _keepAlive = false;
+    }
+
+    _method = _buf;
+    _path = target;
+
+    char *query = strchr(target, '?');
+    if (!query)
+        return true;
+    *query++ = 0;
+
+    while (*query && _args < HTTP_MAX_ARGS)
+    {
+        char *next = strchr(query, '&');
+        if (next)
+            *next++ = 0;
+        char *value = strchr(query, '=');
+        if (value)
+            *value++ = 0;
+        else
+            value = query + strlen(query); // "?flag" -> empty value
+        urlDecode(query);
+        urlDecode(value);
+        _argNames[_args] = query;
+        _argValues[_args] = value;
+        _args++;
+        if (!next)
+            break;
+        query = next;
+    }
+    return true;
+}
+
+// Drop the request just answered, and as much of its body as has come in, keeping
+// any that came in behind it. readFrom() drops the rest of the body as it arrives.
+void HttpRequest::next()
+{
+    size_t body = _len - _headerLen < _bodyLeft ? _len - _headerLen : _bodyLeft;
+    _bodyLeft -= body;
+    _len -= _headerLen + body;
+    memmove(_buf, _buf + _headerLen + body, _len);
+    _buf[_len] = 0;
+    _headerLen = 0;
+}
+
+const char *HttpRequest::arg(const char *name) const
+{
+    for (uint8_t i = 0; i < _args; i++)
+    {
+        if (!strcmp(_argNames[i], name))
+            return _argValues[i];
+    }
+    return nullptr;
+}
+
+void HttpResponse::reset()
+{
+    _txLen = 0;
+    _txSent = 0;
+    _status = 0;
+    _fill = nullptr;
+    _allow = nullptr;
+    _keepAlive = false;
+    cursor[0] = cursor[1] = cursor[2] = 0;
+}
+
+bool HttpResponse::write(const void *data, size_t len)
+{
+    if (len > sizeof(_tx) - _txLen)
+        return false;
+    memcpy(_tx + _txLen, data, len);
+    _txLen += len;
+    return true;
+}
+
+bool HttpResponse::write(const char *text)
+{
+    return write(text, strlen(text));
+}
+
+void HttpResponse::beginStream(int status, const char *contentType, long contentLength, HttpBodyFill fill)
+{
+    char *header = (char *)_tx + _txLen;
+    size_t room = sizeof(_tx) - _txLen;
+    int len;
+    _status = status;
+    _fill = fill;
+    char allow[24] = "";
+    if (_allow)
+        snprintf(allow, sizeof(allow), "Allow: %s\r\n", _allow);
+    if (contentLength == HTTP_CONTENT_LENGTH_UNKNOWN)
+    {
+        _keepAlive = false;
+        len = snprintf(header, room, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n%sConnection: close\r\n\r\n",
+                       status, statusText(status), contentType, allow);
+    }
+    else
+        len = snprintf(header, room, "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %ld\r\n%sConnection: %s\r\n\r\n",
+                       status, statusText(status), contentType, contentLength, allow, _keepAlive ? "keep-alive" : "close");
+    _txLen += len < (int)room ? len : room - 1;
+}
+
+void HttpResponse::send(int status, const char *contentType, const void *body, size_t len)
+{
+    size_t mark = _txLen;
+    beginStream(status, contentType, (long)len);
+    if (write(body, len))
+        return;
+
+    // Doesn't fit. Send what does rather than nothing, but with a header that says how
+    // much that is, and close after it. A header promising the whole body would leave
+    // a persistent client waiting for the rest until we closed. The second header is
+    // no longer than the first ("close", and fewer digits), so what's left fits.
+    size_t fits = sizeof(_tx) - _txLen;
+    _txLen = mark;
+    _keepAlive = false;
+    beginStream(status, contentType, (long)fits);
+    write(body, fits);
+}
+
+void HttpResponse::send(int status, const char *contentType, const char *body)
+{
+    send(status, contentType, body, strlen(body));
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+bool HttpServer::begin(uint16_t port)
+{
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenFd < 0)
+        return false;
+
+    int yes = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(_listenFd, HTTP_MAX_CONNECTIONS) < 0)
+    {
+        close(_listenFd);
+        _listenFd = -1;
+        return false;
+    }
+    setNonBlocking(_listenFd);
+    return true;
+}
+
+bool HttpServer::on(const char *path, HttpMethod method, HttpHandler handler)
+{
+    if (_routeCount >= HTTP_MAX_ROUTES)
+        return false;
+    _routes[_routeCount++] = {path, method, handler, 0, 0};
+    return true;
+}
+
+void HttpServer::handleClient(uint32_t waitMs)
+{
+    wait(waitMs);
+    service();
+}
+
+void HttpServer::wait(uint32_t waitMs)
+{
+    FD_ZERO(&_readable);
+    FD_ZERO(&_writable);
+    _ready = 0;
+    // Only listen when there's room, otherwise a waiting connection would wake us
+    // constantly. Evictable slots free up with time, so cap the wait when full.
+    uint64_t now = SystemClock::nowMs();
+    int maxFd = -1;
+    if (_listenFd >= 0 && freeSlot(now))
+    {
+        FD_SET(_listenFd, &_readable);
+        maxFd = _listenFd;
+    }
+    else if (waitMs > HTTP_EVICT_IDLE_MS)
+        waitMs = HTTP_EVICT_IDLE_MS;
+    if (_wakeFd >= 0)
+    {
+        FD_SET(_wakeFd, &_readable);
+        if (_wakeFd > maxFd)
+            maxFd = _wakeFd;
+    }
+    for (HttpConnection &c : _connections)
+    {
+        if (c.state == HttpConnectionState::READING)
+            FD_SET(c.fd, &_readable);
+        else if (c.state == HttpConnectionState::WRITING)
+            FD_SET(c.fd, &_writable);
+        else
+            continue;
+        if (c.fd > maxFd)
+            maxFd = c.fd;
+    }
+
+    // Not started: nothing to wait on, but the caller still expects to sleep.
+    if (maxFd < 0)
+    {
+        delay(waitMs);
+        return;
+    }
+
+    struct timeval tv = {(long)(waitMs / 1000), (long)((waitMs % 1000) * 1000)};
+    _ready = select(maxFd + 1, &_readable, &_writable, nullptr, &tv);
+}
+
+void HttpServer::service()
+{
+    uint64_t now = SystemClock::nowMs();
+    int ready = _ready;
+    _ready = 0;
+
+    if (ready > 0 && _listenFd >= 0 && FD_ISSET(_listenFd, &_readable))
+        acceptAll(now);
+
+    for (HttpConnection &c : _connections)
+    {
+        if (c.state == HttpConnectionState::FREE)
+            continue;
+        if (ready > 0 && c.state == HttpConnectionState::READING && FD_ISSET(c.fd, &_readable))
+            readFrom(c, now);
+        else if (ready > 0 && c.state == HttpConnectionState::WRITING && FD_ISSET(c.fd, &_writable))
+        {
+            writeTo(c, now);
+            serve(c, now); // Anything pipelined behind that response
+        }
+
+        if (c.state != HttpConnectionState::FREE && now > c.deadline)
+        {
+            if (c.state == HttpConnectionState::READING && c.served && !c.request._len)
+                _stats.idleClosed++;
+            else
+                _stats.timeouts++;
+            closeConnection(c);
+        }
+    }
+}
+
+// A free slot, or failing that the connection that has waited on a request the
+// longest, if it's been at it for HTTP_EVICT_IDLE_MS: a half-sent request, or a new
+// connection that hasn't sent one. Idle clients can't lock the plugs out, but a
+// burst of real requests doesn't knock itself over either.
+//
+// A persistent connection between requests isn't waiting on anything. Dropping it
+// would race its plug's next report, so it stays until HTTP_KEEP_ALIVE_MS.
+// keepAliveRoom() makes sure that can't fill the pool.
+HttpConnection *HttpServer::freeSlot(uint64_t now)
+{
+    HttpConnection *stalest = nullptr;
+    for (HttpConnection &c : _connections)
+    {
+        if (c.state == HttpConnectionState::FREE)
+            return &c;
+        bool betweenRequests = c.served && !c.request._len;
+        if (c.state == HttpConnectionState::READING && !betweenRequests &&
+            (!stalest || c.waitingSince < stalest->waitingSince))
+            stalest = &c;
+    }
+    if (stalest && stalest->waitingSince + HTTP_EVICT_IDLE_MS <= now)
+        return stalest;
+    return nullptr;
+}
+
+// Whether a connection can stay open after its response and still leave a slot
+// free. The last one never persists, so however many plugs there are beyond the
+// pool, each gets in within a request's time, on a connection of its own.
+bool HttpServer::keepAliveRoom() const
+{
+    for (const HttpConnection &c : _connections)
+    {
+        if (c.state == HttpConnectionState::FREE)
+            return true;
+    }
+    return false;
+}
+
+// Accept as many as we have room for. Anyone else waits in the listen backlog
+// until a slot frees up.
+void HttpServer::acceptAll(uint64_t now)
+{
+    HttpConnection *slot;
+    while ((slot = freeSlot(now)))
+    {
+        int fd = accept(_listenFd, nullptr, nullptr);
+        if (fd < 0)
+            return;
+        setNonBlocking(fd);
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        if (slot->state != HttpConnectionState::FREE)
+        {
+            _stats.evicted++;
+            closeConnection(*slot);
+        }
+        slot->fd = fd;
+        slot->state = HttpConnectionState::READING;
+        slot->deadline = now + HTTP_READ_TIMEOUT_MS;
+        slot->waitingSince = now;
+        slot->served = 0;
+        slot->request._len = 0;
+        slot->request._headerLen = 0;
+        slot->request._bodyLeft = 0;
+        slot->response.reset();
+        _stats.accepted++;
+        if (++_stats.active > _stats.peakActive)
+            _stats.peakActive = _stats.active;
+    }
+}
+
+void HttpServer::readFrom(HttpConnection &c, uint64_t now)
+{
+    HttpRequest &request = c.request;
+    int n = recv(c.fd, request._buf + request._len, HTTP_REQUEST_BUFFER - request._len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+    if (n <= 0)
+    {
+        closeConnection(c);
+        return;
+    }
+    if (!request._len)
+    {
+        c.deadline = now + HTTP_READ_TIMEOUT_MS; // A new request on a persistent connection
+        c.waitingSince = now;
+    }
+    if (request._bodyLeft)
+    {
+        // The rest of a body we've already answered without. Nothing before it is
+        // buffered, or next() would have dropped the body from that.
+        size_t skip = (size_t)n < request._bodyLeft ? n : request._bodyLeft;
+        memmove(request._buf, request._buf + skip, n - skip);
+        request._bodyLeft -= skip;
+        n -= skip;
+    }
+    request._len += n;
+    serve(c, now);
+}
+
+// Answer whatever whole requests are buffered, in order, as long as each response
+// goes out without blocking. We need only the request line, but waiting for the end
+// of the headers is how we find the next request, and keeps the client from seeing
+// a reset when we close with its headers unread.
+void HttpServer::serve(HttpConnection &c, uint64_t now)
+{
+    while (c.state == HttpConnectionState::READING && c.request.complete())
+    {
+        if (c.served)
+            _stats.reusedRequests++;
+        dispatch(c);
+        c.state = HttpConnectionState::WRITING;
+        c.deadline = now + HTTP_WRITE_TIMEOUT_MS;
+        writeTo(c, now);
+    }
+}
+
+void HttpServer::dispatch(HttpConnection &c)
+{
+    HttpRequest &request = c.request;
+    HttpResponse &response = c.response;
+
+    _stats.requests++;
+    AllocProbe::begin();
+
+    // Set before the handler so the response headers can say which it'll be.
+    bool parsed = request.parse();
+    response._keepAlive = parsed && request._keepAlive;
+    if (response._keepAlive && !keepAliveRoom())
+    {
+        _stats.closedForRoom++;
+        response._keepAlive = false;
+    }
+
+    HttpRoute *route = nullptr;
+    if (!parsed)
+    {
+        _stats.badRequests++;
+        response.send(400, "text/plain", "Bad request\n");
+    }
+    else
+    {
+        for (uint8_t i = 0; i < _routeCount; i++)
+        {
+            if (!strcmp(_routes[i].path, request.path()))
+            {
+                route = &_routes[i];
+                break;
+            }
+        }
+        if (route && route->method != HttpMethod::ANY && strcmp(request.method(), methodName(route->method)))
+        {
+            _stats.wrongMethod++;
+            response._allow = methodName(route->method);
+            response.send(405, "text/plain", "Method not allowed\n");
+        }
+        else if (route)
+        {
+            route->hits++;
+            route->handler(request, response);
+        }
+        else if (_notFound)
+            _notFound(request, response);
+        else
+            response.send(404, "text/plain", "Not found\n");
+
+        if (!response.status())
+            response.send(500, "text/plain", "No response\n");
+    }
+
+    uint32_t allocations = AllocProbe::end();
+    if (allocations)
+    {
+        _stats.allocatingRequests++;
+        if (route)
+            route->allocations += allocations;
+    }
+}
+
+void HttpServer::writeTo(HttpConnection &c, uint64_t now)
+{
+    HttpResponse &response = c.response;
+    for (;;)
+    {
+        if (response._txSent == response._txLen)
+        {
+            response._txSent = response._txLen = 0;
+            if (response._fill)
+                response._txLen = response._fill(response, response._tx, sizeof(response._tx));
+            if (!response._txLen)
+            {
+                finishResponse(c, now);
+                return;
+            }
+        }
+
+        int n = ::send(c.fd, response._tx + response._txSent, response._txLen - response._txSent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        if (n <= 0)
+        {
+            closeConnection(c);
+            return;
+        }
+        response._txSent += n;
+        c.deadline = now + HTTP_WRITE_TIMEOUT_MS;
+    }
+}
+
+// Close, or go back to reading if the connection is persistent.
+void HttpServer::finishResponse(HttpConnection &c, uint64_t now)
+{
+    if (!c.response._keepAlive)
+    {
+        shutdown(c.fd, SHUT_WR);
+        closeConnection(c);
+        return;
+    }
+
+    _stats.keptAlive++;
+    c.served++;
+    c.request.next();
+    if (c.request._len)
+        _stats.pipelined++;
+    c.response.reset();
+    c.state = HttpConnectionState::READING;
+    c.waitingSince = now;
+    c.deadline = now + (c.request._len ? HTTP_READ_TIMEOUT_MS : HTTP_KEEP_ALIVE_MS);
+}
+
+void HttpServer::closeConnection(HttpConnection &c)
+{
+    close(c.fd);
+    c.fd = -1;
+    c.state = HttpConnectionState::FREE;
+    _stats.active--;
+}
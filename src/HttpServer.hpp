@@ -0,0 +1,233 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include "lwip/sockets.h"
+#else
+#include <sys/select.h>
+#endif
+
+// Small event-driven HTTP/1.x server on plain sockets, replacing the Arduino WebServer.
+//
+// WebServer copies the URI, every argument name and value, and every header into
+// Strings before our handler even runs, so each plug report costs several heap
+// allocations. Here the request is read into one fixed buffer and parsed in place:
+// arguments are NUL-terminated slices of that buffer. Responses are formatted into
+// a fixed per-connection buffer.
+//
+// WebServer also serves one client at a time and blocks while it waits for the
+// request, so a slow or half-open client freezes loop(). Here every socket is
+// non-blocking. handleClient() does one select() over a fixed pool of connections,
+// moves each one along as far as it can without waiting, and returns. Connections
+// that make no progress before their deadline are dropped. When the pool is full new
+// connections wait in the listen backlog, except that one which has sat on a
+// half-sent request for a while makes way for them. Large bodies are pulled from
+// the handler a buffer at a time as the socket drains (see HttpBodyFill).
+//
+// Routes are registered with the method they take, like WebServer's on(path,
+// HTTP_GET, handler); any other gets a 405. A request body isn't read, only skipped
+// by its Content-Length, so it can't be taken for the next request.
+//
+// Connections are persistent unless the client says otherwise (or is HTTP/1.0 and
+// doesn't ask), so a plug reporting every second pays for one TCP handshake, not
+// one per reading. Pipelined requests queue up in the request buffer and are
+// answered in order, one response at a time. A persistent connection that goes
+// quiet is closed after HTTP_KEEP_ALIVE_MS. One slot is always kept for a new
+// connection: a response that would take the last one closes its connection
+// instead, so there can be more plugs than HTTP_MAX_CONNECTIONS.
+//
+// Works against lwIP sockets on the ESP32 and BSD sockets on the host.
+
+#define HTTP_MAX_CONNECTIONS 6 // lwIP only has 10 sockets in total
+#define HTTP_REQUEST_BUFFER 512
+#define HTTP_TX_BUFFER 1024
+#define HTTP_MAX_ARGS 8
+#define HTTP_MAX_ROUTES 12
+#define HTTP_READ_TIMEOUT_MS 2000  // To get a complete request
+#define HTTP_WRITE_TIMEOUT_MS 5000 // Without the client taking any of the response
+#define HTTP_EVICT_IDLE_MS 500     // Half-sent requests older than this can be dropped when full
+#define HTTP_KEEP_ALIVE_MS 15000   // Waiting for the next request on a persistent connection
+#define HTTP_CONTENT_LENGTH_UNKNOWN -1
+
+class HttpRequest
+{
+    friend class HttpServer;
+
+private:
+    char _buf[HTTP_REQUEST_BUFFER + 1];
+    size_t _len = 0;
+    size_t _headerLen = 0;   // End of the current request's headers
+    uint32_t _bodyLeft = 0;  // Body bytes of the current request still to skip
+    bool _truncated = false; // Filled the buffer without ending
+    bool _keepAlive = false;
+    const char *_method = "";
+    const char *_path = "";
+    const char *_argNames[HTTP_MAX_ARGS];
+    const char *_argValues[HTTP_MAX_ARGS];
+    uint8_t _args = 0;
+
+    bool complete();
+    bool parse();
+    void next();
+
+public:
+    const char *method() const { return _method; }
+    const char *path() const { return _path; }
+    uint8_t args() const { return _args; }
+    const char *argName(uint8_t i) const { return i < _args ? _argNames[i] : ""; }
+    const char *argValue(uint8_t i) const { return i < _args ? _argValues[i] : ""; }
+
+    // URL-decoded value, or nullptr if the argument isn't there.
+    const char *arg(const char *name) const;
+    bool hasArg(const char *name) const { return arg(name) != nullptr; }
+
+    // Whether the client wants the connection kept open after this one.
+    bool keepAlive() const { return _keepAlive; }
+};
+
+class HttpResponse;
+
+// Produces the next piece of a streamed body into buf. Returns the bytes written,
+// 0 when the body is finished. Keep its position in response.cursor.
+typedef size_t (*HttpBodyFill)(HttpResponse &response, uint8_t *buf, size_t size);
+
+class HttpResponse
+{
+    friend class HttpServer;
+
+private:
+    uint8_t _tx[HTTP_TX_BUFFER];
+    size_t _txLen = 0;
+    size_t _txSent = 0;
+    int _status = 0;
+    HttpBodyFill _fill = nullptr;
+    const char *_allow = nullptr; // Allow header, for a 405
+    bool _keepAlive = false;
+
+    void reset();
+
+public:
+    // Scratch space for an HttpBodyFill to remember where it's up to.
+    uint32_t cursor[3];
+
+    // One-shot response. The body is copied, so it must fit in HTTP_TX_BUFFER; what
+    // doesn't is cut off, the header says so, and the connection is closed.
+    void send(int status, const char *contentType, const char *body);
+    void send(int status, const char *contentType, const void *body, size_t len);
+
+    // Streaming response: headers now, then write() anything that fits in the buffer,
+    // then fill is called for the rest as the client takes it.
+    // With HTTP_CONTENT_LENGTH_UNKNOWN the body ends when we close the connection, so
+    // that connection isn't kept alive.
+    void beginStream(int status, const char *contentType, long contentLength, HttpBodyFill fill = nullptr);
+    bool write(const void *data, size_t len);
+    bool write(const char *text);
+
+    int status() const { return _status; }
+};
+
+typedef void (*HttpHandler)(HttpRequest &request, HttpResponse &response);
+
+enum class HttpMethod : uint8_t
+{
+    ANY,
+    GET,
+    POST,
+    PUT,
+    DELETE
+};
+
+struct HttpRoute
+{
+    const char *path;
+    HttpMethod method;
+    HttpHandler handler;
+    uint32_t hits;
+    uint32_t allocations; // Heap allocations made while handling, see AllocProbe
+};
+
+struct HttpStats
+{
+    uint32_t requests;
+    uint32_t badRequests;
+    uint32_t wrongMethod; // Answered 405
+    uint32_t allocatingRequests; // Requests that touched the heap
+    uint32_t accepted;
+    uint32_t evicted; // Idle connections dropped to make room for a new one
+    uint32_t timeouts;
+    uint32_t keptAlive;      // Responses after which the connection stayed open
+    uint32_t reusedRequests; // Requests that came in on an already used connection
+    uint32_t pipelined;      // ...of which were sent before the previous response finished
+    uint32_t idleClosed;     // Persistent connections closed after HTTP_KEEP_ALIVE_MS
+    uint32_t closedForRoom;  // Responses that closed rather than take the last slot
+    uint8_t active;
+    uint8_t peakActive;
+};
+
+enum class HttpConnectionState : uint8_t
+{
+    FREE,
+    READING,
+    WRITING
+};
+
+struct HttpConnection
+{
+    int fd = -1;
+    HttpConnectionState state = HttpConnectionState::FREE;
+    uint64_t deadline = 0;
+    uint64_t waitingSince = 0; // Since the connection opened, or its current request began
+    uint32_t served = 0;
+    HttpRequest request;
+    HttpResponse response;
+};
+
+class HttpServer
+{
+private:
+    int _listenFd = -1;
+    HttpRoute _routes[HTTP_MAX_ROUTES];
+    uint8_t _routeCount = 0;
+    HttpHandler _notFound = nullptr;
+    HttpStats _stats = {};
+    HttpConnection _connections[HTTP_MAX_CONNECTIONS];
+    int _wakeFd = -1;
+    fd_set _readable; // What wait() found ready, for service()
+    fd_set _writable;
+    int _ready = 0;
+
+    HttpConnection *freeSlot(uint64_t now);
+    bool keepAliveRoom() const;
+    void acceptAll(uint64_t now);
+    void readFrom(HttpConnection &c, uint64_t now);
+    void serve(HttpConnection &c, uint64_t now);
+    void dispatch(HttpConnection &c);
+    void writeTo(HttpConnection &c, uint64_t now);
+    void finishResponse(HttpConnection &c, uint64_t now);
+    void closeConnection(HttpConnection &c);
+
+public:
+    bool begin(uint16_t port);
+    bool on(const char *path, HttpMethod method, HttpHandler handler);
+    bool on(const char *path, HttpHandler handler) { return on(path, HttpMethod::ANY, handler); }
+    void onNotFound(HttpHandler handler) { _notFound = handler; }
+
+    // Move every connection along as far as it goes without blocking. Waits up to
+    // waitMs for something to happen first; 0 just polls. Call from loop().
+    void handleClient(uint32_t waitMs = 0);
+
+    // handleClient() in two halves, for a caller that wants to tell time spent
+    // asleep from time spent serving: wait() blocks, service() does the work.
+    void wait(uint32_t waitMs);
+    void service();
+
+    // Also stop waiting when fd is readable, e.g. the UDP socket, so one wait covers
+    // every way a reading can arrive. handleClient() doesn't read from it.
+    void wakeOn(int fd) { _wakeFd = fd; }
+
+    const HttpStats &stats() const { return _stats; }
+    uint8_t routeCount() const { return _routeCount; }
+    const HttpRoute &route(uint8_t i) const { return _routes[i]; }
+};
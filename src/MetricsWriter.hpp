@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "Profiler.hpp"
+
+// Prometheus text format, written straight into a response buffer. /metrics is a
+// streamed response (HttpBodyFill) made of sections, each a few metrics: a fill
+// writes whole sections until one doesn't fit, takes that one back out, and picks
+// it up again in the next buffer. So nothing is built up on the heap and no
+// section has to know how much room is left.
+//
+//   MetricsWriter out(buf, size);
+//   out.help("heatplug_readings_received_total", "counter", "Readings taken");
+//   out.value("heatplug_readings_received_total", received);
+//   out.value("heatplug_state", "plug", "0", "state", "HOT", 1);
+
+class MetricsWriter
+{
+private:
+    char *_buf;
+    size_t _size;
+    size_t _len = 0;
+    bool _overflowed = false;
+
+public:
+    MetricsWriter(uint8_t *buf, size_t size) : _buf((char *)buf), _size(size) {}
+
+    // Any line at all. /stats is written with this and value().
+    __attribute__((format(printf, 2, 3))) void append(const char *fmt, ...)
+    {
+        if (_overflowed)
+            return;
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(_buf + _len, _size - _len, fmt, args);
+        va_end(args);
+        if (n < 0 || (size_t)n >= _size - _len)
+            _overflowed = true;
+        else
+            _len += n;
+    }
+
+    void help(const char *name, const char *type, const char *help)
+    {
+        append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    void value(const char *name, uint64_t v) { append("%s %llu\n", name, (unsigned long long)v); }
+    void decimal(const char *name, double v) { append("%s %.6g\n", name, v); }
+
+    // With one label: name{key="label"} v
+    void value(const char *name, const char *key, const char *label, uint64_t v)
+    {
+        append("%s{%s=\"%s\"} %llu\n", name, key, label, (unsigned long long)v);
+    }
+
+    // ...and two.
+    void value(const char *name, const char *key, const char *label, const char *key2, const char *label2, uint64_t v)
+    {
+        append("%s{%s=\"%s\",%s=\"%s\"} %llu\n", name, key, label, key2, label2, (unsigned long long)v);
+    }
+
+    // A ProfileStage as a histogram in seconds. Read without resetting, as these are
+    // counters. Every other bucket, 4us, 16us, 64us ... 65ms, so the whole histogram
+    // fits in one section.
+    void histogram(const char *name, const char *help, ProfileStage &stage)
+    {
+        ProfileStats stats = stage.read(false);
+        this->help(name, "histogram", help);
+        uint32_t cumulative = 0;
+        for (uint8_t i = 0; i < PROFILE_BUCKETS - 1; i++)
+        {
+            cumulative += stats.buckets[i];
+            if (i % 2 == 0)
+                append("%s_bucket{le=\"%g\"} %u\n", name, profileBucketLimitUs(i) / 1e6, cumulative);
+        }
+        cumulative += stats.buckets[PROFILE_BUCKETS - 1];
+        append("%s_bucket{le=\"+Inf\"} %u\n", name, cumulative);
+        append("%s_sum %.6f\n", name, (double)stats.totalCycles / profileCyclesPerUs() / 1e6);
+        append("%s_count %u\n", name, cumulative);
+    }
+
+    size_t length() const { return _len; }
+    bool overflowed() const { return _overflowed; }
+
+    // Back to an earlier length(), e.g. the start of a section that didn't fit.
+    void rewind(size_t len)
+    {
+        _len = len;
+        _overflowed = false;
+    }
+};
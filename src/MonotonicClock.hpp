@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp_timer.h"
+#endif
+
+// Clock sources for HeaterMonitor. Everything is milliseconds in 64 bits so nothing
+// wraps at 49.7 days like millis() does.
+
+// The real clock. On the ESP32 esp_timer is already a 64-bit microsecond counter.
+// Anywhere else we widen millis() by counting wraps, which only needs nowMs() to be
+// called at least once every 49 days. loop() does that many times a second. The
+// count is per thread, as the host build runs the firmware's tasks as threads.
+struct SystemClock
+{
+    static uint64_t nowMs()
+    {
+#ifdef ARDUINO_ARCH_ESP32
+        return (uint64_t)esp_timer_get_time() / 1000;
+#else
+        static thread_local uint32_t last = 0;
+        static thread_local uint64_t high = 0;
+        uint32_t now = (uint32_t)millis();
+        if (now < last)
+            high += 1ULL << 32;
+        last = now;
+        return high | now;
+#endif
+    }
+};
+
+// Simulation clock. Only moves when told to, so a replay can jump hours ahead
+// deterministically. Static so any number of monitors in a simulation share it.
+struct VirtualClock
+{
+    static uint64_t &now()
+    {
+        static uint64_t t = 0;
+        return t;
+    }
+    static uint64_t nowMs() { return now(); }
+    static void set(uint64_t ms) { now() = ms; }
+    static void advance(uint64_t ms) { now() += ms; }
+};
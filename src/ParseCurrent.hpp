@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Parse a Tasmota current value ("12.345", "0.1", "7") into milliamps without going
+// through String/toFloat. Rounds past the third decimal. Returns false on anything
+// that isn't a plain decimal number, so junk doesn't become 0A, and on anything over
+// PARSE_MAX_AMPS either way, so nothing a client sends can overflow.
+
+#define PARSE_MAX_AMPS 1000 // Not a heater
+
+inline bool parseMilliamps(const char *s, int32_t *mA)
+{
+    if (!s)
+        return false;
+
+    bool negative = false;
+    if (*s == '-' || *s == '+')
+        negative = *s++ == '-';
+
+    int32_t whole = 0;
+    int digits = 0;
+    while (*s >= '0' && *s <= '9')
+    {
+        whole = whole * 10 + (*s++ - '0');
+        if (whole > PARSE_MAX_AMPS)
+            return false;
+        digits++;
+    }
+
+    int32_t frac = 0;
+    if (*s == '.')
+    {
+        s++;
+        int places = 0;
+        while (*s >= '0' && *s <= '9')
+        {
+            if (places < 3)
+                frac = frac * 10 + (*s - '0');
+            else if (places == 3 && *s >= '5')
+                frac++;
+            places++;
+            digits++;
+            s++;
+        }
+        for (; places < 3; places++)
+            frac *= 10;
+    }
+
+    while (*s == ' ' || *s == '\r' || *s == '\n')
+        s++;
+    if (!digits || *s)
+        return false;
+
+    int32_t value = whole * 1000 + frac;
+    *mA = negative ? -value : value;
+    return true;
+}
+
+// A plug id, "0" up to count - 1. No id at all (nullptr) is plug 0, so a plug that
+// doesn't send one is the sign's first.
+inline bool parsePlug(const char *s, uint8_t count, uint8_t *plug)
+{
+    if (!s)
+    {
+        *plug = 0;
+        return true;
+    }
+    uint32_t id = 0;
+    int digits = 0;
+    while (*s >= '0' && *s <= '9' && digits < 3)
+    {
+        id = id * 10 + (*s++ - '0');
+        digits++;
+    }
+    if (!digits || *s || id >= count)
+        return false;
+    *plug = id;
+    return true;
+}
+
+// Tasmota's /cm?cmnd=/current?value=12.345, maybe with "&plug=3" on the end when the
+// plug escaped the &. plugId gets what follows plug=, and is left alone if there's
+// nothing after the value.
+inline bool parseCurrentCommand(const char *cmnd, int32_t *mA, const char **plugId)
+{
+    static const char prefix[] = "/current?value=";
+    static const char plugPrefix[] = "&plug=";
+    if (!cmnd)
+        return false;
+    for (const char *p = prefix; *p; p++)
+        if (*cmnd++ != *p)
+            return false;
+    char value[16];
+    size_t len = 0;
+    while (cmnd[len] && cmnd[len] != '&')
+    {
+        if (len == sizeof(value) - 1)
+            return false;
+        value[len] = cmnd[len];
+        len++;
+    }
+    value[len] = 0;
+    if (!parseMilliamps(value, mA))
+        return false;
+    cmnd += len;
+    if (!*cmnd)
+        return true;
+    for (const char *p = plugPrefix; *p; p++)
+        if (*cmnd++ != *p)
+            return false;
+    *plugId = cmnd;
+    return true;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "HeaterState.hpp"
+#include "ReadingFilter.hpp"
+#include "SampleQueue.hpp"
+
+// A HeaterMonitor per plug, for when the sign's access point serves several. Kept as
+// a column per field rather than an array of monitors, sized at compile time, so 16
+// plugs is about 1.3KB of static memory, most of it filters, and never touches the
+// heap. The state machine is BasicHeaterMonitor's, run on a row through HeaterFields.
+//
+// Plug 0 is the one that reports without a plug id, and counts as active from the
+// start, so a sign with one plug behaves as it always has. Any other plug becomes
+// active with its first reading and stays that way.
+//
+// Each plug's readings go through a ReadingFilter before its state machine, all with
+// the same settings, readingFilterFor(Profile) unless setFilter() says otherwise.
+
+template <typename Clock, size_t N, const HeaterProfile &Profile = HEATER_PROFILE>
+class PlugTable
+{
+    static_assert(N >= 1 && N <= 32, "PlugTable keeps active plugs in a 32-bit mask");
+
+    int32_t _milliamps[N] = {};     // Latest reading
+    ReadingFilter _filter[N];       // Readings so far, smoothed for the state machine
+    uint64_t _readingMs[N] = {};    // Clock time it arrived, 0 before the first
+    HeaterState _state[N];
+    HeaterTrend _trend[N];
+    uint64_t _stateSinceMs[N] = {};
+    uint64_t _trendSinceMs[N] = {};
+    bool _unknown[N] = {};
+    uint32_t _active = 1;
+    ReadingFilterConfig _filterConfig = readingFilterFor(Profile);
+
+    HeaterFields row(uint8_t plug)
+    {
+        return {_state[plug], _trend[plug], _stateSinceMs[plug], _trendSinceMs[plug], _unknown[plug]};
+    }
+
+public:
+    PlugTable()
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            _state[i] = HeaterState::STARTUP;
+            _trend[i] = HeaterTrend::UNKNOWN;
+        }
+    }
+
+    static constexpr size_t size() { return N; }
+
+    // One reading through the plug's state machine, as HeaterMonitor::update() would.
+    void update(uint8_t plug, int32_t milliamps, uint64_t updateTime)
+    {
+        _milliamps[plug] = milliamps;
+        _readingMs[plug] = updateTime;
+        _active |= 1u << plug;
+        if (_unknown[plug])
+            _filter[plug].reset(); // What it read before it was lost says nothing about now
+        int32_t filtered = _filter[plug].add(milliamps, _filterConfig);
+        BasicHeaterMonitor<Clock, Profile>::update(row(plug), filtered / 1000.0f, updateTime);
+    }
+
+    // Every active plug again with the reading it last had, so one that's stopped
+    // reporting goes to UNKNOWN. One pass down the columns.
+    void updateAll()
+    {
+        for (uint8_t i = 0; i < N; i++)
+            if (_active >> i & 1)
+                BasicHeaterMonitor<Clock, Profile>::update(row(i), _filter[i].value() / 1000.0f, _readingMs[i]);
+    }
+
+    // As HeaterMonitor::drain(), with each reading going to its own plug.
+    template <typename Queue>
+    uint32_t drain(Queue &queue, uint32_t max, Sample *changedBy = nullptr)
+    {
+        return queue.drain([this, changedBy](const Sample &sample)
+                           {
+            HeaterState state = _state[sample.plug];
+            HeaterTrend trend = _trend[sample.plug];
+            update(sample.plug, sample.milliamps, sample.ms);
+            if (changedBy && (state != _state[sample.plug] || trend != _trend[sample.plug]))
+                *changedBy = sample; }, max);
+    }
+
+    // For readings from now on; what's in each filter stays.
+    void setFilter(const ReadingFilterConfig &config) { _filterConfig = config; }
+    const ReadingFilterConfig &filter() const { return _filterConfig; }
+
+    uint32_t activeMask() const { return _active; }
+    bool active(uint8_t plug) const { return _active >> plug & 1; }
+    HeaterState state(uint8_t plug) const { return _state[plug]; }
+    HeaterTrend trend(uint8_t plug) const { return _trend[plug]; }
+    int32_t milliamps(uint8_t plug) const { return _milliamps[plug]; }
+    int32_t filteredMilliamps(uint8_t plug) const { return _filter[plug].value(); }
+    uint64_t readingMs(uint8_t plug) const { return _readingMs[plug]; }
+
+    HeaterSnapshot snapshot(uint8_t plug) const
+    {
+        return {_state[plug], _trend[plug], _stateSinceMs[plug], _trendSinceMs[plug]};
+    }
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include <stdio.h>
+
+#ifndef ARDUINO_ARCH_ESP32
+#include <time.h>
+#endif
+
+// Always-on timing of the firmware's stages, to find the stalls we only see in the
+// field. Each stage counts its runs, total and worst time, and keeps a histogram in
+// fixed power-of-two buckets. /profile shows them, and can zero them as it reads.
+//
+// Time is taken from the CPU cycle counter, a register read on the ESP32. On the
+// host it's nanoseconds instead. Either way it's 32 bits, so anything over ~17s on
+// the ESP32 (~4s on the host) comes out short.
+//
+// A stage may be timed from either task. The counters are atomic adds, so two
+// tasks, or a reset from /profile, never lose a run.
+
+#define PROFILE_BUCKETS 16 // Under 4us, then up to 8us, 16us, ... and 65ms or more
+#define PROFILE_LINE_MAX 400 // Longest describe() line
+
+inline uint32_t profileCycles()
+{
+#ifdef ARDUINO_ARCH_ESP32
+    return ESP.getCycleCount();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+#endif
+}
+
+inline uint32_t profileCyclesPerUs()
+{
+#ifdef ARDUINO_ARCH_ESP32
+    static const uint32_t mhz = getCpuFrequencyMhz();
+    return mhz;
+#else
+    return 1000;
+#endif
+}
+
+// Upper bound of a histogram bucket in microseconds, 0 for the last one.
+inline uint32_t profileBucketLimitUs(uint8_t bucket) { return bucket < PROFILE_BUCKETS - 1 ? 4u << bucket : 0; }
+
+struct ProfileStats
+{
+    uint32_t count;
+    uint64_t totalCycles;
+    uint32_t worstCycles;
+    uint32_t buckets[PROFILE_BUCKETS];
+};
+
+class ProfileStage
+{
+private:
+    const char *_name;
+    std::atomic<uint32_t> _count{0};
+    std::atomic<uint64_t> _totalCycles{0}; // 64 bits, or it'd wrap after 17s of work
+    std::atomic<uint32_t> _worstCycles{0};
+    std::atomic<uint32_t> _buckets[PROFILE_BUCKETS] = {};
+
+public:
+    explicit ProfileStage(const char *name) : _name(name) {}
+
+    void record(uint32_t cycles)
+    {
+        uint32_t us = cycles / profileCyclesPerUs();
+        uint8_t bucket = us < 4 ? 0 : 30 - __builtin_clz(us);
+        if (bucket >= PROFILE_BUCKETS)
+            bucket = PROFILE_BUCKETS - 1;
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _totalCycles.fetch_add(cycles, std::memory_order_relaxed);
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        uint32_t worst = _worstCycles.load(std::memory_order_relaxed);
+        while (cycles > worst && !_worstCycles.compare_exchange_weak(worst, cycles, std::memory_order_relaxed))
+            ;
+    }
+
+    // For a time measured some other way, like a latency across tasks.
+    void recordUs(uint32_t us)
+    {
+        uint32_t perUs = profileCyclesPerUs();
+        record(us < UINT32_MAX / perUs ? us * perUs : UINT32_MAX);
+    }
+
+    // The counters as they stand, zeroing them too if reset. A run recorded
+    // meanwhile shows up in this read or the next, not both or neither.
+    ProfileStats read(bool reset)
+    {
+        ProfileStats stats;
+        stats.count = reset ? _count.exchange(0, std::memory_order_relaxed) : _count.load(std::memory_order_relaxed);
+        stats.totalCycles = reset ? _totalCycles.exchange(0, std::memory_order_relaxed) : _totalCycles.load(std::memory_order_relaxed);
+        stats.worstCycles = reset ? _worstCycles.exchange(0, std::memory_order_relaxed) : _worstCycles.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+            stats.buckets[i] = reset ? _buckets[i].exchange(0, std::memory_order_relaxed) : _buckets[i].load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // One line per stage: the totals, then "<limit_us>:runs" for each bucket that
+    // has any, "inf" being the last. Returns the length, cut to fit.
+    int describe(char *out, size_t size, bool reset)
+    {
+        ProfileStats stats = read(reset);
+        uint32_t perUs = profileCyclesPerUs();
+        int len = snprintf(out, size, "%s count %u total_us %llu mean_us %.2f worst_us %u worst_cycles %u buckets",
+                           _name, stats.count, (unsigned long long)(stats.totalCycles / perUs),
+                           stats.count ? (double)stats.totalCycles / perUs / stats.count : 0.0, stats.worstCycles / perUs,
+                           stats.worstCycles);
+        for (uint8_t i = 0; i < PROFILE_BUCKETS && len < (int)size; i++)
+        {
+            if (!stats.buckets[i])
+                continue;
+            if (profileBucketLimitUs(i))
+                len += snprintf(out + len, size - len, " %u:%u", profileBucketLimitUs(i), stats.buckets[i]);
+            else
+                len += snprintf(out + len, size - len, " inf:%u", stats.buckets[i]);
+        }
+        if (len < (int)size)
+            len += snprintf(out + len, size - len, "\n");
+        return len < (int)size ? len : size - 1;
+    }
+
+    const char *name() const { return _name; }
+};
+
+// Times its scope into a stage:
+//   { ProfileTimer t(httpStage); server.service(); }
+class ProfileTimer
+{
+private:
+    ProfileStage &_stage;
+    uint32_t _start;
+
+public:
+    explicit ProfileTimer(ProfileStage &stage) : _stage(stage), _start(profileCycles()) {}
+    ~ProfileTimer() { _stage.record(profileCycles() - _start); }
+};
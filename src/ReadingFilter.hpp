@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include "HeaterProfile.hpp"
+
+// Smooths a plug's readings before the state machine sees them. It used to classify
+// every raw reading, so one glitch flipped the trend, reset how long it's been
+// heating, and redrew the sign, and noise around a threshold did it over and over.
+//
+// Each reading goes through a running median of the last few, which throws out
+// single glitches, then an exponential moving average, which evens out noise. A
+// median that's moved a long way from the average is the heater switching, not
+// noise, and is taken as it is. That costs every change window / 2 readings, clean
+// or not: with the default window of 3, each state and trend change lands at least
+// one report later than it did unfiltered. Smaller changes ramp in over a few more.
+//
+// "A long way" comes from the profile (readingFilterFor()). It's at most the width
+// of the MAINTAINING band, so the average never ramps all the way across it. A lamp
+// going from 0 to 0.4A under homeTestingProfile would otherwise pass through
+// maintaining on the way up and the plug go OFF to HOT, not OFF to WARM.
+//
+// Fixed point throughout. Readings are milliamps, the average keeps 8 more bits.
+// Constant work per reading: the median sorts at most READING_FILTER_MAX_WINDOW.
+
+#define READING_FILTER_MAX_WINDOW 7 // Odd, and one less than the ring
+#define READING_FILTER_RING 8
+
+#ifndef READING_FILTER_WINDOW
+#define READING_FILTER_WINDOW 3 // Readings in the median, 1 for none
+#endif
+#ifndef READING_FILTER_EMA_SHIFT
+#define READING_FILTER_EMA_SHIFT 2 // Each median counts 1/2^shift of the average, 0 for none
+#endif
+#ifndef READING_FILTER_STEP_MA
+#define READING_FILTER_STEP_MA 1000 // A median this far off the average is taken as is, at most
+#endif
+
+struct ReadingFilterConfig
+{
+    uint8_t window;   // Odd, 1 to READING_FILTER_MAX_WINDOW
+    uint8_t emaShift; // 0 to 6, so the average settles within a quarter milliamp
+    int32_t stepMa;
+
+    constexpr bool valid() const
+    {
+        return window % 2 == 1 && window <= READING_FILTER_MAX_WINDOW && emaShift <= 6 && stepMa > 0;
+    }
+};
+
+// The settings for a profile: READING_FILTER_STEP_MA, or the width of its
+// MAINTAINING band if that's narrower.
+constexpr ReadingFilterConfig readingFilterFor(const HeaterProfile &profile)
+{
+    int32_t bandMa = (int32_t)((profile.heatingCurrentA - profile.maintainingCurrentA) * 1000);
+    return {READING_FILTER_WINDOW, READING_FILTER_EMA_SHIFT,
+            bandMa < READING_FILTER_STEP_MA ? bandMa : READING_FILTER_STEP_MA};
+}
+
+inline constexpr ReadingFilterConfig readingFilterDefault = readingFilterFor(HEATER_PROFILE);
+// Readings straight through, as before there was a filter.
+inline constexpr ReadingFilterConfig readingFilterOff = {1, 0, READING_FILTER_STEP_MA};
+
+static_assert(readingFilterFor(fieldProfile).valid() && readingFilterFor(homeTestingProfile).valid(),
+              "Bad READING_FILTER_* settings");
+
+class ReadingFilter
+{
+    int32_t _recent[READING_FILTER_RING]; // Last readings, raw. All of the ring, so the window can change.
+    int64_t _average = 0;                 // Milliamps << 8
+    uint8_t _next = 0;                    // Where the next reading goes
+    bool _primed = false;
+
+    int32_t recent(uint8_t back) const { return _recent[(_next - 1 - back) & (READING_FILTER_RING - 1)]; }
+
+    int32_t median(uint8_t window) const
+    {
+        if (window == 3) // The usual one, without the sort's branches
+        {
+            int32_t a = recent(0), b = recent(1), c = recent(2);
+            int32_t lo = a < b ? a : b, hi = a < b ? b : a;
+            return c < lo ? lo : (c > hi ? hi : c);
+        }
+        int32_t sorted[READING_FILTER_MAX_WINDOW];
+        for (uint8_t i = 0; i < window; i++)
+        {
+            int32_t v = recent(i);
+            uint8_t j = i;
+            for (; j > 0 && sorted[j - 1] > v; j--)
+                sorted[j] = sorted[j - 1];
+            sorted[j] = v;
+        }
+        return sorted[window / 2];
+    }
+
+public:
+    // Takes a reading and returns the filtered one. The first reading fills the
+    // window and the average, so a fresh filter starts where the plug is.
+    int32_t add(int32_t milliamps, const ReadingFilterConfig &config)
+    {
+        if (!_primed)
+        {
+            for (int32_t &r : _recent)
+                r = milliamps;
+            _average = (int64_t)milliamps * 256; // Not << 8: milliamps can be negative
+            _primed = true;
+        }
+        _recent[_next] = milliamps;
+        _next = (_next + 1) & (READING_FILTER_RING - 1);
+
+        int32_t m = config.window > 1 ? median(config.window) : milliamps;
+        int64_t target = (int64_t)m * 256;
+        int64_t off = target - _average;
+        if (off >= (int64_t)config.stepMa << 8 || off <= -((int64_t)config.stepMa << 8))
+            _average = target;
+        else
+            _average += off >> config.emaShift;
+        return value();
+    }
+
+    // Start again from the next reading.
+    void reset() { _primed = false; }
+
+    // The filtered reading, to the nearest milliamp.
+    int32_t value() const { return (int32_t)((_average + 128) >> 8); }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Running min/max/mean/count of current at a few resolutions, so a dashboard can ask
+// for "the last week" without us walking 600k raw samples. Every sample touches each
+// tier once: either it lands in the open bucket or it closes that one and opens the
+// next. Intervals with no readings simply have no bucket; each bucket carries its
+// own start time. Values are in the same 10mA units as SampleHistory.
+
+struct RollupBucket
+{
+    uint32_t startS; // SystemClock seconds, aligned to the tier period
+    uint32_t sum;
+    uint16_t minU;
+    uint16_t maxU;
+    uint16_t count;
+    uint16_t reserved;
+};
+
+template <uint32_t PeriodS, uint32_t Buckets>
+class RollupTier
+{
+private:
+    RollupBucket _buckets[Buckets];
+    uint32_t _head = 0; // Open bucket
+    uint32_t _count = 0;
+
+public:
+    static const uint32_t period = PeriodS;
+    static const uint32_t capacity = Buckets;
+
+    void add(uint32_t nowS, uint16_t units)
+    {
+        uint32_t start = nowS - nowS % PeriodS;
+        RollupBucket *b = &_buckets[_head];
+        if (!_count || b->startS != start)
+        {
+            if (_count)
+                _head = (_head + 1) % Buckets;
+            if (_count < Buckets)
+                _count++;
+            b = &_buckets[_head];
+            b->startS = start;
+            b->sum = 0;
+            b->minU = 0xFFFF;
+            b->maxU = 0;
+            b->count = 0;
+        }
+        if (units < b->minU)
+            b->minU = units;
+        if (units > b->maxU)
+            b->maxU = units;
+        // Once count is full the mean is of the readings it counted, so sum stops too.
+        // 0xFFFF of them at the most 0xFFFF units each still fits sum.
+        if (b->count < 0xFFFF)
+        {
+            b->sum += units;
+            b->count++;
+        }
+    }
+
+    uint32_t count() const { return _count; }
+
+    // i = 0 is the newest (still open) bucket.
+    const RollupBucket &newest(uint32_t i) const
+    {
+        return _buckets[(_head + Buckets - i) % Buckets];
+    }
+};
+
+// 2 minutes of seconds, a day of minutes, a week of hours. About 28KB.
+class Rollups
+{
+public:
+    RollupTier<1, 120> seconds;
+    RollupTier<60, 1440> minutes;
+    RollupTier<3600, 168> hours;
+
+    void add(uint64_t nowMs, uint16_t units)
+    {
+        uint32_t nowS = nowMs / 1000;
+        seconds.add(nowS, units);
+        minutes.add(nowS, units);
+        hours.add(nowS, units);
+    }
+
+    bool hasTier(uint32_t periodS) const
+    {
+        return periodS == seconds.period || periodS == minutes.period || periodS == hours.period;
+    }
+
+    // Buckets held at the given resolution, 0 if there is no such tier.
+    uint32_t count(uint32_t periodS) const
+    {
+        if (periodS == seconds.period)
+            return seconds.count();
+        if (periodS == minutes.period)
+            return minutes.count();
+        if (periodS == hours.period)
+            return hours.count();
+        return 0;
+    }
+
+    // i = 0 is the newest (still open) bucket. Check count() first.
+    const RollupBucket &newest(uint32_t periodS, uint32_t i) const
+    {
+        if (periodS == seconds.period)
+            return seconds.newest(i);
+        if (periodS == minutes.period)
+            return minutes.newest(i);
+        return hours.newest(i);
+    }
+};
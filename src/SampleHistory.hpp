@@ -0,0 +1,171 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Ring buffer of every current reading we've received, for /history.
+//
+// Each sample is one 16-bit word:
+//   bits 15-12  seconds since the previous sample (0-15)
+//   bits 11-0   current in 10mA steps (0-40.94A). 0xFFF means "no reading".
+// Gaps longer than 15s are filled with "no reading" words 15s apart, so a lost plug
+// shows up as a hole instead of stretching the previous value. At 1 Hz that's
+// 2 bytes/sec, 169KB for 24 hours.
+//
+// The ESP32 rarely has one free block that big, so the ring is split into 8KB pages
+// allocated once at startup. If the heap runs low we stop allocating pages and keep
+// a shorter history rather than starve WiFi. Nothing is allocated after begin().
+
+#define HISTORY_PAGE_RECORDS 4096
+#define HISTORY_MA_PER_UNIT 10
+#define HISTORY_NO_READING 0xFFF
+#define HISTORY_MAX_DT_S 15
+
+struct __attribute__((packed)) HistoryHeader
+{
+    char magic[4];          // "HPH1"
+    uint32_t count;         // samples that follow
+    uint32_t capacity;      // samples the ring can hold
+    uint32_t oldestUptimeS; // SystemClock seconds of the first sample
+    uint32_t newestUptimeS; // SystemClock seconds of the last sample
+    uint32_t nowUptimeS;    // SystemClock seconds when this was sent
+    uint32_t nowEpochS;     // wall clock when this was sent, 0 if not set
+    uint16_t maPerUnit;     // HISTORY_MA_PER_UNIT
+    uint16_t reserved;
+};
+
+// Amps to 10mA units, clamped to what fits in 12 bits.
+inline uint16_t currentToUnits(float amps)
+{
+    if (!(amps > 0))
+        return 0;
+    long units = lround(amps * (1000.0f / HISTORY_MA_PER_UNIT));
+    return units >= HISTORY_NO_READING ? HISTORY_NO_READING - 1 : (uint16_t)units;
+}
+
+template <uint32_t Capacity>
+class SampleHistory
+{
+private:
+    static const uint32_t MAX_PAGES = (Capacity + HISTORY_PAGE_RECORDS - 1) / HISTORY_PAGE_RECORDS;
+
+    uint16_t *_pages[MAX_PAGES] = {};
+    uint32_t _capacity = 0;
+    uint32_t _head = 0; // Next slot to write
+    uint32_t _count = 0;
+    uint32_t _total = 0; // Samples ever written. Sequence number of the next one.
+    uint32_t _oldestS = 0;
+    uint32_t _newestS = 0;
+
+    uint16_t &slot(uint32_t i)
+    {
+        return _pages[i / HISTORY_PAGE_RECORDS][i % HISTORY_PAGE_RECORDS];
+    }
+
+    void push(uint16_t word)
+    {
+        if (_count == _capacity)
+        {
+            // Drop the oldest. The new oldest sample's delta moves the start time forward.
+            _count--;
+            uint32_t oldest = (_head + _capacity - _count) % _capacity;
+            _oldestS += slot(oldest) >> 12;
+        }
+        slot(_head) = word;
+        _head = (_head + 1) % _capacity;
+        _count++;
+        _total++;
+    }
+
+public:
+    ~SampleHistory()
+    {
+        for (uint32_t p = 0; p < MAX_PAGES; p++)
+            free(_pages[p]);
+    }
+
+    // Allocate the ring, keeping at least reserveBytes of heap free for everything else.
+    // Returns the number of samples we can hold.
+    uint32_t begin(size_t reserveBytes)
+    {
+#ifndef ARDUINO_ARCH_ESP32
+        (void)reserveBytes; // The host doesn't run short
+#endif
+        for (uint32_t p = 0; p < MAX_PAGES && !_pages[p]; p++)
+        {
+            size_t bytes = HISTORY_PAGE_RECORDS * sizeof(uint16_t);
+#ifdef ARDUINO_ARCH_ESP32
+            if (ESP.getFreeHeap() < reserveBytes + bytes)
+                break;
+#endif
+            _pages[p] = (uint16_t *)malloc(bytes);
+            if (!_pages[p])
+                break;
+            _capacity += HISTORY_PAGE_RECORDS;
+        }
+        if (_capacity > Capacity)
+            _capacity = Capacity;
+        return _capacity;
+    }
+
+    // value is in 10mA units, see currentToUnits().
+    void add(uint64_t nowMs, uint16_t value)
+    {
+        if (!_capacity)
+            return;
+
+        uint32_t nowS = nowMs / 1000;
+        if (!_count)
+        {
+            _oldestS = _newestS = nowS;
+            push(value);
+            return;
+        }
+
+        uint32_t dt = nowS - _newestS;
+        while (dt > HISTORY_MAX_DT_S)
+        {
+            push((HISTORY_MAX_DT_S << 12) | HISTORY_NO_READING);
+            dt -= HISTORY_MAX_DT_S;
+        }
+        push((dt << 12) | value);
+        _newestS = nowS;
+    }
+
+    uint32_t count() const { return _count; }
+    uint32_t capacity() const { return _capacity; }
+    size_t bytes() const { return (size_t)_capacity * sizeof(uint16_t); }
+
+    void header(HistoryHeader &h, uint64_t nowMs, uint32_t nowEpochS) const
+    {
+        memcpy(h.magic, "HPH1", 4);
+        h.count = _count;
+        h.capacity = _capacity;
+        h.oldestUptimeS = _oldestS;
+        h.newestUptimeS = _newestS;
+        h.nowUptimeS = nowMs / 1000;
+        h.nowEpochS = nowEpochS;
+        h.maPerUnit = HISTORY_MA_PER_UNIT;
+        h.reserved = 0;
+    }
+
+    // Sequence numbers of the oldest sample and one past the newest. They keep counting
+    // as the ring wraps, so a reader can come back later and pick up where it was.
+    uint32_t firstSeq() const { return _total - _count; }
+    uint32_t endSeq() const { return _total; }
+
+    // Copy up to n samples starting at sequence number seq. Samples that have been
+    // overwritten since the reader started come back as "no reading", so a download
+    // that started before a wrap still gets the length it was promised.
+    uint32_t copy(uint32_t seq, uint16_t *out, uint32_t n)
+    {
+        uint32_t copied = 0;
+        for (; copied < n && seq != _total; copied++, seq++)
+        {
+            if (_total - seq > _count)
+                out[copied] = HISTORY_NO_READING;
+            else
+                out[copied] = slot((_head + _capacity - (_total - seq)) % _capacity);
+        }
+        return copied;
+    }
+};
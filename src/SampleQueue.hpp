@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+// Readings on their way from the HTTP and UDP handlers to HeaterMonitor. Handlers
+// used to overwrite one global that the monitor looked at once a pass, so a second
+// reading in the same pass was lost, and the one kept got the pass's time rather
+// than its own. Now every reading is queued with the time it arrived and the
+// monitor takes them all, in order (HeaterMonitor::drain()).
+//
+// One producer and one consumer, no locks, so they may be different tasks. When it's
+// full new readings are dropped, not old ones: only the consumer may move the tail.
+
+// A reading as it arrived.
+struct Sample
+{
+    uint64_t ms; // SystemClock time it arrived
+    int32_t milliamps;
+    uint32_t arrivedUs; // micros() then, for measuring how long it takes to show
+    uint8_t plug;       // Which one sent it, see PlugTable.hpp
+};
+
+// Each counter is written by one side only.
+struct SampleQueueStats
+{
+    uint32_t pushed;    // Readings queued
+    uint32_t dropped;   // ...refused because the queue was full
+    uint32_t overflows; // Times it filled up. Each may drop many.
+    uint32_t peak;      // Most ever waiting at once
+    uint32_t drained;   // Readings taken off
+    uint32_t batches;   // drain() calls that took any
+};
+
+template <size_t N>
+class SampleQueue
+{
+    static_assert(N && (N & (N - 1)) == 0, "SampleQueue size must be a power of two");
+
+    Sample _ring[N];
+    std::atomic<uint32_t> _head{0}; // Next to write. Only push() moves it.
+    std::atomic<uint32_t> _tail{0}; // Next to read. Only drain() moves it.
+    bool _full = false;             // Producer side: dropping since the last push that fit
+    SampleQueueStats _stats = {};
+
+public:
+    // Producer. False if it's full and the reading was dropped.
+    bool push(const Sample &sample)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t waiting = head - _tail.load(std::memory_order_acquire);
+        if (waiting == N)
+        {
+            _stats.dropped++;
+            if (!_full)
+                _stats.overflows++;
+            _full = true;
+            return false;
+        }
+        _ring[head % N] = sample;
+        _head.store(head + 1, std::memory_order_release);
+        _full = false;
+        _stats.pushed++;
+        if (waiting + 1 > _stats.peak)
+            _stats.peak = waiting + 1;
+        return true;
+    }
+
+    // Consumer. Hands up to max readings to take(sample), oldest first, then frees
+    // their slots all at once. Returns how many.
+    template <typename F>
+    uint32_t drain(F &&take, uint32_t max = N)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        uint32_t waiting = _head.load(std::memory_order_acquire) - tail;
+        uint32_t n = waiting < max ? waiting : max;
+        for (uint32_t i = 0; i < n; i++)
+            take(_ring[(tail + i) % N]);
+        _tail.store(tail + n, std::memory_order_release);
+        if (n)
+        {
+            _stats.drained += n;
+            _stats.batches++;
+        }
+        return n;
+    }
+
+    uint32_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return N; }
+    const SampleQueueStats &stats() const { return _stats; }
+};
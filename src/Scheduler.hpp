@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Arduino.h>
+
+// A fixed table of timers for a task that sleeps between jobs. The task asks
+// msUntilNext() how long it may sleep, blocks on whatever else can wake it (sockets,
+// a task notification) for at most that long, then calls runDue(). Timers either
+// repeat every periodMs, or are one-shot and set again with at(), which is how
+// deadlines like "the next minute" or "2am" work.
+//
+// It also keeps count of how the task spends its time: wake-ups, time awake and
+// time asleep, per timer runs and how late they were. /stats shows them.
+
+#define SCHEDULER_MAX_TIMERS 4
+
+typedef void (*SchedulerJob)(uint64_t nowMs);
+
+struct SchedulerTimer
+{
+    const char *name;
+    uint32_t periodMs; // 0 for one-shot
+    uint64_t dueMs;    // 0 for not set
+    SchedulerJob job;
+    uint32_t runs;
+    uint32_t worstLateMs;
+};
+
+struct SchedulerStats
+{
+    uint32_t wakeups;  // Times the task came out of its sleep
+    uint64_t awakeUs;  // Time between waking and going back to sleep
+    uint64_t asleepUs; // ...and the rest
+};
+
+class Scheduler
+{
+private:
+    SchedulerTimer _timers[SCHEDULER_MAX_TIMERS];
+    uint8_t _count = 0;
+    SchedulerStats _stats = {};
+    uint32_t _mark = 0; // micros() when the task last went to sleep or woke
+
+public:
+    // Returns the timer's id for at(), or -1 if the table is full.
+    int every(const char *name, uint32_t periodMs, SchedulerJob job, uint64_t firstDueMs)
+    {
+        if (_count == SCHEDULER_MAX_TIMERS)
+            return -1;
+        _timers[_count] = {name, periodMs, firstDueMs, job, 0, 0};
+        return _count++;
+    }
+
+    int oneShot(const char *name, SchedulerJob job) { return every(name, 0, job, 0); }
+
+    void at(int id, uint64_t dueMs) { _timers[id].dueMs = dueMs; }
+
+    // How long until a timer is due, at most maxMs.
+    uint32_t msUntilNext(uint64_t nowMs, uint32_t maxMs) const
+    {
+        uint64_t wait = maxMs;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            const SchedulerTimer &t = _timers[i];
+            if (!t.dueMs)
+                continue;
+            if (t.dueMs <= nowMs)
+                return 0;
+            if (t.dueMs - nowMs < wait)
+                wait = t.dueMs - nowMs;
+        }
+        return wait;
+    }
+
+    // Run every timer that's due. A repeating timer keeps its phase unless it fell a
+    // whole period behind. Returns how many ran.
+    uint32_t runDue(uint64_t nowMs)
+    {
+        uint32_t ran = 0;
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            SchedulerTimer &t = _timers[i];
+            if (!t.dueMs || t.dueMs > nowMs)
+                continue;
+            if (nowMs - t.dueMs > t.worstLateMs)
+                t.worstLateMs = nowMs - t.dueMs;
+            if (!t.periodMs)
+                t.dueMs = 0;
+            else
+            {
+                t.dueMs += t.periodMs;
+                if (t.dueMs <= nowMs)
+                    t.dueMs = nowMs + t.periodMs;
+            }
+            t.runs++;
+            t.job(nowMs);
+            ran++;
+        }
+        return ran;
+    }
+
+    // Call once when the task starts, then either side of its blocking wait.
+    void begin() { _mark = micros(); }
+
+    void sleeping()
+    {
+        uint32_t now = micros();
+        _stats.awakeUs += now - _mark;
+        _mark = now;
+    }
+
+    void woke()
+    {
+        uint32_t now = micros();
+        _stats.asleepUs += now - _mark;
+        _mark = now;
+        _stats.wakeups++;
+    }
+
+    const SchedulerStats &stats() const { return _stats; }
+    uint8_t timerCount() const { return _count; }
+    const SchedulerTimer &timer(uint8_t i) const { return _timers[i]; }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// One writer, any number of readers, no locks. The writer never waits. A reader
+// that overlaps a write sees the sequence number change and copies again, so it
+// only ever gets a whole value, never half of an old one and half of a new one.
+//
+// Used to hand HeaterMonitor's state from the ingest task to the render task (see
+// SignTasks.cpp) so neither can hold the other up, and the display schedule, which is
+// big but hardly ever written. T must be plain data. It's kept as 32-bit atomic
+// words so the copy isn't a data race. A reader retries the whole copy, so a big T
+// should be one that's rarely written.
+template <typename T>
+class Seqlock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Seqlock holds plain data only");
+    static const size_t WORDS = (sizeof(T) + 3) / 4;
+
+    std::atomic<uint32_t> _seq{0}; // Odd while a write is under way
+    std::atomic<uint32_t> _words[WORDS] = {};
+
+public:
+    void write(const T &value)
+    {
+        uint32_t words[WORDS] = {};
+        memcpy(words, &value, sizeof(T));
+
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++)
+            _words[i].store(words[i], std::memory_order_relaxed);
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // False if a write got in the way; value is untouched.
+    bool tryRead(T &value) const
+    {
+        uint32_t before = _seq.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+        uint32_t words[WORDS];
+        for (size_t i = 0; i < WORDS; i++)
+            words[i] = _words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_seq.load(std::memory_order_relaxed) != before)
+            return false;
+        memcpy(&value, words, sizeof(T));
+        return true;
+    }
+
+    // Copies until it gets a whole value. Returns how many tries failed first.
+    uint32_t read(T &value) const
+    {
+        uint32_t retries = 0;
+        while (!tryRead(value))
+            retries++;
+        return retries;
+    }
+
+    // Goes up by two with every write.
+    uint32_t version() const { return _seq.load(std::memory_order_acquire); }
+};
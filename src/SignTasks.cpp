@@ -0,0 +1,1122 @@
+#include <atomic>
+#include <sys/time.h>
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "freertos/task.h"
+#include "SignTasks.hpp"
+#include "DisplaySchedule.hpp"
+#include "HeaterState.hpp"
+#include "Profiler.hpp"
+#include "Seqlock.hpp"
+#include "Rollups.hpp"
+#include "MetricsWriter.hpp"
+#include "ParseCurrent.hpp"
+#include "HardwareConstants.h"
+#include "TomThumbCAC.h"
+#include "ImpactFull12.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp_heap_caps.h"
+#endif
+
+// See SignTasks.hpp. What the firmware's main.cpp used to hold, from the readings
+// coming in to the frame going out.
+
+void handleUdpReading(const UdpReading &reading);
+void handleCommand(HttpRequest &request, HttpResponse &response);
+void handleCurrentReading(HttpRequest &request, HttpResponse &response);
+void handleStats(HttpRequest &request, HttpResponse &response);
+void handleSchedule(HttpRequest &request, HttpResponse &response);
+void handleProfile(HttpRequest &request, HttpResponse &response);
+void handleMetrics(HttpRequest &request, HttpResponse &response);
+void handleNotFound(HttpRequest &request, HttpResponse &response);
+void updateDisplay(HeaterState curState, uint8_t plug);
+void drawPlugDots();
+void updateTimer(const HeaterSnapshot &heater);
+bool shouldDisplayBeOn();
+
+SignOptions signOptions;
+HttpServer server;
+UdpIngest udpIngest;
+static std::atomic<bool> stopping{false};
+
+
+// When the display may be on while the heater's off, see DisplaySchedule.hpp. This one
+// is built into the firmware; /schedule replaces it and the replacement is kept in NVS.
+constexpr ScheduleSpan defaultSpans[] = {
+    {1, 8 * 60, 22 * 60},  // Monday
+    {2, 8 * 60, 22 * 60},  // Tuesday
+    {3, 8 * 60, 22 * 60},  // Wednesday
+    {4, 8 * 60, 22 * 60},  // Thursday
+    {5, 8 * 60, 19 * 60},  // Friday
+    {6, 8 * 60, 18 * 60},  // Saturday
+    {0, 12 * 60, 18 * 60}, // Sunday
+};
+constexpr WeekSchedule defaultSchedule = weekSchedule(defaultSpans);
+static_assert(defaultSchedule.on(1, 8, 0) && !defaultSchedule.on(1, 7, 59) && !defaultSchedule.on(5, 19, 0),
+              "Default schedule doesn't say what the spans say");
+
+#define SCHEDULE_NVS_NAMESPACE "sign"
+#define SCHEDULE_NVS_KEY "schedule"
+Preferences prefs;
+Seqlock<WeekSchedule> scheduleState; // Written by /schedule on ingest, read by render
+
+uint64_t lastCurUpdate = 0;   // SystemClock ms, from any plug
+uint32_t readingsAccepted = 0; // Over HTTP and UDP, and queued, for /metrics
+uint32_t readingsRejected = 0; // Over HTTP, including none at all. UDP counts its own.
+uint32_t readingsBadPlug = 0;  // A plug id past PLUG_COUNT, any way it came
+
+// Every accepted reading goes through here to its plug's monitor, see SampleQueue.hpp.
+#define SAMPLE_QUEUE_SIZE 64
+SampleQueue<SAMPLE_QUEUE_SIZE> readings;
+
+SampleHistory<HISTORY_CAPACITY> history;
+Rollups rollups;
+void recordReading(float amps, uint64_t when);
+void handleHistory(HttpRequest &request, HttpResponse &response);
+void handleRollup(HttpRequest &request, HttpResponse &response);
+
+// Each plug's state machine, see PlugTable.hpp. Owned by ingest; render gets copies
+// through signState.
+SignPlugs plugs;
+static_assert(PLUG_COUNT <= UDP_MAX_PLUGS, "UDP can't tell that many plugs apart");
+
+// The work is split over two tasks. Ingest, on core 0 with the WiFi stack, serves
+// HTTP and UDP, runs the state machine and the 2am time fetch, and publishes what
+// the display needs to signState. Render, on core 1, draws from the latest copy of
+// that. A slow HTTP client can't hold up the display, and a slow redraw can't hold
+// up a reading. Nothing else is shared but the display schedule and counters for
+// /stats.
+//
+// Neither task spins. Each sleeps until something happens or its next timer is due
+// (see Scheduler.hpp): ingest in select() on the HTTP and UDP sockets, render on a
+// task notification that ingest sends when the snapshot changes.
+#define INGEST_CORE 0
+#define RENDER_CORE 1
+#define INGEST_STACK 8192
+#define RENDER_STACK 8192
+#define INGEST_MAX_SLEEP_MS 1000 // Connection timeouts are checked at least this often
+#define RENDER_MAX_SLEEP_MS 60000
+#define LIVENESS_MS 1000         // A monitor pass with nothing new, to notice when readings stop
+#define RESYNC_RETRY_MS 10000    // After a failed 2am time fetch, while it's still 2:00
+
+struct SignSnapshot
+{
+  HeaterSnapshot heaters[PLUG_COUNT];
+  uint32_t activePlugs; // PlugTable::activeMask()
+  uint32_t timeFetches; // 2am time fetches tried
+  bool timeFetchFailed; // ...and whether the last one failed
+  uint32_t readingUs;   // micros() when the reading that made this change arrived, 0 if none did
+};
+Seqlock<SignSnapshot> signState;
+bool snapshotPlugs(SignSnapshot &snapshot);
+std::atomic<uint32_t> snapshotRetries{0};
+TaskHandle_t ingestHandle = nullptr;
+TaskHandle_t renderHandle = nullptr;
+void ingestTask(void *);
+void renderTask(void *);
+
+// Each task's timers. Their counters are read by /stats on the ingest task as they
+// stand, so a render figure may be a moment out of date.
+Scheduler ingestScheduler;
+Scheduler renderScheduler;
+int resyncTimer;
+int timerTick;
+int minuteTimer;
+int pageTimer;
+uint32_t timeFetches = 0;
+bool timeFetchFailed = false;
+SignSnapshot sign;     // Render's copy
+uint8_t shownPlug = 0; // The plug on the panel
+bool displayOn = true; // shouldDisplayBeOn() as of the last minute rollover
+WeekSchedule schedule; // Render's copy of scheduleState
+uint32_t scheduleVersion = 0;
+
+// Where each task's time goes, for /profile. See Profiler.hpp.
+ProfileStage httpStage("http");            // Serving sockets and running handlers, not the wait
+ProfileStage udpStage("udp");              // Reading the UDP socket
+ProfileStage monitorStage("monitor");      // A batch of readings through HeaterMonitor, or a liveness pass
+ProfileStage resyncStage("resync");        // The 2am time fetch, all of it
+ProfileStage localTimeStage("local_time"); // getLocalTime(), which can wait
+ProfileStage displayStage("display");      // updateDisplay()
+ProfileStage timerStage("timer");          // updateTimer()
+ProfileStage flushStage("flush");          // Sending a frame to the panel
+ProfileStage readingToDisplay("reading_to_display"); // Not a stage: reading arrived to frame sent, for /metrics
+ProfileStage *const profileStages[] = {&httpStage, &udpStage, &monitorStage, &resyncStage,
+                                       &localTimeStage, &displayStage, &timerStage, &flushStage};
+
+// Fixed strings, measured by the compiler rather than on every redraw.
+constexpr MeasuredText hotText = measured(Impact12CapsMetrics, "HOT");
+constexpr MeasuredText warmText = measured(Impact12CapsMetrics, "WARM");
+constexpr MeasuredText coldText = measured(Impact12CapsMetrics, "COLD");
+constexpr MeasuredText offText = measured(Impact12CapsMetrics, "OFF");
+constexpr MeasuredText unknownText = measured(Impact12CapsMetrics, "????");
+static_assert(warmText.bounds.w <= PANEL_RES_X, "WARM doesn't fit on the panel");
+
+// The line under the state word, for the timer or the time of day.
+constexpr TextArea bottomLine = {0, 21, 64, 11};
+
+// Milliseconds from now until the next hour:minute local time, or 0 if the clock
+// hasn't been set.
+uint64_t msUntilLocal(int hour, int minute)
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < 1600000000)
+    return 0;
+  struct tm local;
+  localtime_r(&tv.tv_sec, &local);
+  long secs = ((hour - local.tm_hour) * 60 + (minute - local.tm_min)) * 60 - local.tm_sec;
+  if (secs <= 0)
+    secs += 24 * 60 * 60;
+  return secs * 1000ULL - tv.tv_usec / 1000;
+}
+
+// Milliseconds until the clock next reaches :00 seconds.
+uint64_t msUntilNextMinute()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (60 - tv.tv_sec % 60) * 1000ULL - tv.tv_usec / 1000;
+}
+
+// Every plug's state into snapshot, and whether it's changed.
+bool snapshotPlugs(SignSnapshot &snapshot)
+{
+  bool changed = snapshot.activePlugs != plugs.activeMask();
+  snapshot.activePlugs = plugs.activeMask();
+  for (uint8_t i = 0; i < PLUG_COUNT; i++)
+  {
+    if (!plugs.active(i))
+      continue;
+    HeaterSnapshot heater = plugs.snapshot(i);
+    HeaterSnapshot &was = snapshot.heaters[i];
+    changed |= heater.state != was.state || heater.trend != was.trend || heater.trendSinceMs != was.trendSinceMs;
+    was = heater;
+  }
+  return changed;
+}
+
+// Hand render a new snapshot, and wake it, if anything it shows has changed.
+void publishSignState(uint32_t readingUs)
+{
+  static SignSnapshot published = {};
+  if (!snapshotPlugs(published) && timeFetches == published.timeFetches)
+    return;
+  published.timeFetches = timeFetches;
+  published.timeFetchFailed = timeFetchFailed;
+  published.readingUs = readingUs;
+  signState.write(published);
+  xTaskNotifyGive(renderHandle);
+}
+
+void checkLiveness(uint64_t)
+{
+  if (!readings.size())
+  {
+    ProfileTimer profile(monitorStage);
+    plugs.updateAll();
+  }
+  publishSignState();
+}
+
+void logReading(uint64_t)
+{
+  for (uint8_t i = 0; i < PLUG_COUNT; i++)
+    if (plugs.active(i))
+      Serial.printf("Plug %u reading: %.2f filtered: %.2f curState: %d @ %llu\n", i, plugs.milliamps(i) / 1000.0f,
+                    plugs.filteredMilliamps(i) / 1000.0f, (int)plugs.state(i), (unsigned long long)plugs.readingMs(i));
+}
+
+// getLocalTime(), timed. It waits up to 5s for the clock to be set.
+bool localTime(struct tm *timeinfo)
+{
+  ProfileTimer profile(localTimeStage);
+  return getLocalTime(timeinfo);
+}
+
+// Update the time at 2am local time. We can try a few times in the first minute if
+// the update fails.
+void resyncTime(uint64_t)
+{
+  ProfileTimer profile(resyncStage);
+  struct tm timeinfo;
+  localTime(&timeinfo);
+  Serial.println("Updating time at 2am");
+  Serial.println(&timeinfo, "Old time: %A, %B %d %Y %H:%M:%S");
+  configTime(0, 0, "pool.ntp.org", "time.nist.gov");
+  setenv("TZ", "CST6CDT,M3.2.0,M11.1.0", 1);
+  tzset();
+
+  timeFetches++;
+  if (!localTime(&timeinfo))
+  {
+    Serial.println("Failed to obtain time");
+    timeFetchFailed = true;
+  }
+  else
+  { // Print the time
+    Serial.println(&timeinfo, "New time: %A, %B %d %Y %H:%M:%S");
+    timeFetchFailed = false;
+  }
+  publishSignState();
+
+  uint64_t next = msUntilLocal(2, 0);
+  if (timeFetchFailed && next > 24 * 60 * 60 * 1000ULL - 60000 + RESYNC_RETRY_MS)
+    next = RESYNC_RETRY_MS; // Still 2:00
+  else if (!next)
+    next = 60 * 60 * 1000; // No clock. Try again in an hour.
+  ingestScheduler.at(resyncTimer, SystemClock::nowMs() + next);
+}
+
+void ingestTask(void *)
+{
+  uint64_t now = SystemClock::nowMs();
+  ingestScheduler.every("liveness", LIVENESS_MS, checkLiveness, now + LIVENESS_MS);
+  ingestScheduler.every("log", 5000, logReading, now + 5000);
+  resyncTimer = ingestScheduler.oneShot("resync", resyncTime);
+  uint64_t resync = msUntilLocal(2, 0);
+  ingestScheduler.at(resyncTimer, now + (resync ? resync : 60 * 60 * 1000));
+  ingestScheduler.begin();
+
+  while (!stopping)
+  {
+    // Sleep until a socket has something or a timer is due. Readings left over from a
+    // big batch mean no sleep at all.
+    ingestScheduler.sleeping();
+    if (signOptions.pollMs)
+    {
+      delay(signOptions.pollMs);
+      server.wait(0);
+    }
+    else
+      server.wait(readings.size() ? 0 : ingestScheduler.msUntilNext(SystemClock::nowMs(), INGEST_MAX_SLEEP_MS));
+    ingestScheduler.woke();
+
+    uint32_t start = profileCycles();
+    server.service();
+    httpStage.record(profileCycles() - start);
+
+    start = profileCycles();
+    udpIngest.poll();
+    udpStage.record(profileCycles() - start);
+
+    start = profileCycles();
+    Sample changedBy = {};
+    if (plugs.drain(readings, signOptions.batch, &changedBy))
+    {
+      monitorStage.record(profileCycles() - start);
+      publishSignState(changedBy.arrivedUs);
+    }
+    ingestScheduler.runDue(SystemClock::nowMs());
+  }
+  xTaskNotifyGive(renderHandle); // So it sees stopping too
+  vTaskDelete(nullptr);
+}
+
+// The plugs to page through: every active one, but while the schedule has the display
+// off only those that aren't OFF. If that's none, plug 0, which turns the panel off.
+uint32_t pagedPlugs()
+{
+  uint32_t paged = 0;
+  for (uint8_t i = 0; i < PLUG_COUNT; i++)
+    if ((sign.activePlugs >> i & 1) && (displayOn || sign.heaters[i].state != HeaterState::OFF))
+      paged |= 1u << i;
+  return paged ? paged : 1;
+}
+
+// Show the next plug due a page after from, or from itself if it's the only one.
+uint8_t nextPagedPlug(uint8_t from)
+{
+  uint32_t paged = pagedPlugs();
+  for (uint8_t i = 1; i <= PLUG_COUNT; i++)
+  {
+    uint8_t plug = (from + i) % PLUG_COUNT;
+    if (paged >> plug & 1)
+      return plug;
+  }
+  return from;
+}
+
+// Draw whichever plug is shown: its state word, its bottom line, and the dots along
+// the top once there's more than one.
+void showPlug()
+{
+  if (!(pagedPlugs() >> shownPlug & 1))
+    shownPlug = nextPagedPlug(shownPlug);
+  updateDisplay(sign.heaters[shownPlug].state, shownPlug);
+  updateTimer(sign.heaters[shownPlug]);
+  drawPlugDots();
+}
+
+// Start or stop the 200ms timer tick to match what's on the bottom line, and the page
+// turns to match how many plugs there are to show.
+void armTimerTick(uint64_t now)
+{
+  HeaterState state = sign.heaters[shownPlug].state;
+  bool showing = displayOn && state != HeaterState::OFF && state != HeaterState::STARTUP;
+  if (!showing)
+    renderScheduler.at(timerTick, 0);
+  else if (!renderScheduler.timer(timerTick).dueMs)
+    renderScheduler.at(timerTick, now + signOptions.timerTickMs);
+
+  bool paging = signOptions.pageMs && __builtin_popcount(pagedPlugs()) > 1;
+  if (!paging)
+    renderScheduler.at(pageTimer, 0);
+  else if (!renderScheduler.timer(pageTimer).dueMs)
+    renderScheduler.at(pageTimer, now + signOptions.pageMs);
+}
+
+void redrawTimer(uint64_t)
+{
+  updateTimer(sign.heaters[shownPlug]);
+}
+
+void turnPage(uint64_t now)
+{
+  shownPlug = nextPagedPlug(shownPlug);
+  showPlug();
+  armTimerTick(now);
+}
+
+// The schedule and the time of day only change by the minute.
+void minuteRollover(uint64_t now)
+{
+  if (scheduleState.version() != scheduleVersion)
+  {
+    scheduleVersion = scheduleState.version();
+    scheduleState.read(schedule);
+  }
+  displayOn = shouldDisplayBeOn();
+  showPlug();
+  armTimerTick(now);
+  renderScheduler.at(minuteTimer, now + msUntilNextMinute());
+}
+
+void renderTask(void *)
+{
+  uint64_t now = SystemClock::nowMs();
+  uint32_t timeFetchesShown = 0;
+  signState.read(sign);
+  timerTick = renderScheduler.every("timer", signOptions.timerTickMs, redrawTimer, 0);
+  minuteTimer = renderScheduler.oneShot("minute", minuteRollover);
+  pageTimer = renderScheduler.every("page", signOptions.pageMs, turnPage, 0);
+  renderScheduler.at(minuteTimer, now); // Straight away, to find out if the display's on
+  renderScheduler.begin();
+
+  while (!stopping)
+  {
+    renderScheduler.sleeping();
+    uint32_t wait = renderScheduler.msUntilNext(SystemClock::nowMs(), RENDER_MAX_SLEEP_MS);
+    if (signOptions.pollMs)
+    {
+      delay(signOptions.pollMs);
+      wait = 0;
+    }
+    bool changed = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+    renderScheduler.woke();
+
+    now = SystemClock::nowMs();
+    uint32_t readingUs = 0;
+    if (changed)
+    {
+      snapshotRetries.fetch_add(signState.read(sign), std::memory_order_relaxed);
+      readingUs = sign.readingUs;
+      showPlug();
+      armTimerTick(now);
+
+      // A new schedule. Have the minute rollover pick it up now.
+      if (scheduleState.version() != scheduleVersion)
+        renderScheduler.at(minuteTimer, now);
+
+      // Say how the 2am time fetch went, until the timer line is next redrawn.
+      if (sign.timeFetches != timeFetchesShown)
+      {
+        timeFetchesShown = sign.timeFetches;
+        dmaDisplay->setFont(&TomThumb);
+        dmaDisplay->fillRect(0, 21, 64, 11, COLOR_BLACK);
+        if (sign.timeFetchFailed)
+          dmaDisplay->printAt(0, 28, COLOR_RED, "Time fetch error");
+        else
+          dmaDisplay->printAt(0, 28, COLOR_GREEN, "Time updated");
+      }
+    }
+    renderScheduler.runDue(now);
+
+    // Everything above drew into the shadow buffer. Send what changed to the panel.
+    ProfileTimer profile(flushStage);
+    if (dmaDisplay->flush() && signOptions.onFrame)
+      signOptions.onFrame(dmaDisplay->frontFrame());
+    if (readingUs)
+      readingToDisplay.recordUs(micros() - readingUs);
+  }
+  vTaskDelete(nullptr);
+}
+
+void updateDisplay(HeaterState curState, uint8_t plug)
+{
+  ProfileTimer profile(displayStage);
+  static HeaterState lastState = HeaterState::STARTUP;
+  static uint8_t lastPlug = 0;
+
+  
+
+  if (curState==HeaterState::OFF && !displayOn)
+  {
+    // Turn off the display and bail
+    dmaDisplay->setBrightness8(0);
+    // Set the lastState to something that will force a refresh when the display is turned back on in the a.m.
+    lastState = HeaterState::UNKNOWN;
+    return;
+  }
+
+  // Need to refresh when the display goes from displayOn == false to true.
+
+
+  
+  
+  // If no change, bail to prevent flicker.
+  if (curState == lastState && plug == lastPlug)
+  {
+    return;
+  }
+
+  int bottomY = 20;
+  dmaDisplay->setFont(&Impact12Caps);
+  switch (curState)
+  {
+  case HeaterState::HOT:
+    dmaDisplay->fillScreen(COLOR_BLACK);
+    dmaDisplay->printCenter(32, bottomY, COLOR_RED, hotText);
+    dmaDisplay->setBrightness8(255);
+    break;
+  case HeaterState::WARM:
+    dmaDisplay->fillScreen(COLOR_BLACK);
+    dmaDisplay->printCenter(32, bottomY, COLOR_DARKORANGE, warmText);
+    dmaDisplay->setBrightness8(255);
+    break;
+  case HeaterState::COOL:
+    dmaDisplay->fillScreen(COLOR_BLACK);
+    dmaDisplay->printCenter(32, bottomY, COLOR_BLUE, coldText);
+    dmaDisplay->setBrightness8(255);
+    break;
+  case HeaterState::OFF:
+    dmaDisplay->fillScreen(COLOR_BLACK);
+    dmaDisplay->printCenter(32, bottomY, COLOR_WHITE, offText);
+    dmaDisplay->setBrightness8(10);
+    break;
+  case HeaterState::UNKNOWN:
+    dmaDisplay->fillScreen(COLOR_BLACK);
+    dmaDisplay->printCenter(32, bottomY, COLOR_ORANGE, unknownText);
+    dmaDisplay->setBrightness8(255);
+    break;
+  case HeaterState::STARTUP: // Stays on the boot screen
+    break;
+  }
+
+  lastState = curState;
+  lastPlug = plug;
+
+  return;
+}
+
+// With more than one plug, the top row is a dot for each, at its plug id times four
+// pixels across and the colour of its state, the one on the panel in white. The state
+// words start two rows down, so there's room. Redrawn whole every time; flush() only
+// sends what changed.
+void drawPlugDots()
+{
+  static const uint16_t stateColors[] = {COLOR_WHITE20, COLOR_BLUE, COLOR_WHITE50, COLOR_DARKORANGE, COLOR_RED, COLOR_ORANGE};
+  static_assert(PANEL_RES_X / PLUG_COUNT >= 3, "No room for a dot per plug");
+  if (__builtin_popcount(sign.activePlugs) < 2)
+    return;
+  dmaDisplay->fillRect(0, 0, PANEL_RES_X, 1, COLOR_BLACK);
+  for (uint8_t i = 0; i < PLUG_COUNT; i++)
+    if (sign.activePlugs >> i & 1)
+      dmaDisplay->fillRect(i * (PANEL_RES_X / PLUG_COUNT), 0, 2, 1,
+                           i == shownPlug ? COLOR_WHITE : stateColors[(int)sign.heaters[i].state]);
+}
+
+// Update the timer display: how long since the trend last changed.
+void updateTimer(const HeaterSnapshot &heater)
+{
+  ProfileTimer profile(timerStage);
+  long durSeconds = (SystemClock::nowMs() - heater.trendSinceMs) / 1000;
+  // format seconds into hh:mm:ss
+  long hours = durSeconds / 3600;
+  long minutes = (durSeconds % 3600) / 60;
+  long secs = durSeconds % 60;
+  // Format time. Skip hours if it's 0.
+  char durationStr[24];
+
+  if (hours > 0)
+  {
+    snprintf(durationStr, sizeof(durationStr), "%ld:%02ld:%02ld", hours, minutes, secs);
+  }
+  else
+  {
+    snprintf(durationStr, sizeof(durationStr), "%ld:%02ld", minutes, secs);
+  }
+
+  // Select color based on current trend.
+  HeaterTrend heatTrend = heater.trend;
+  uint16_t trendColor = COLOR_WHITE;
+  const char *timeText = "";
+
+  switch (heatTrend)
+  {
+  case HeaterTrend::HEATING:
+    trendColor = COLOR_RED;
+    timeText = "Heating for: ";
+    break;
+  case HeaterTrend::COOLING:
+    trendColor = COLOR_LIGHTBLUE;
+    timeText = "Cooling for: ";
+    break;
+  case HeaterTrend::MAINTAINING:
+    trendColor = COLOR_GREEN;
+    timeText = "Ready for: ";
+    break;
+  case HeaterTrend::IDLE:
+    trendColor = COLOR_WHITE;
+    timeText = "Idle for: ";
+    break;
+  case HeaterTrend::UNKNOWN:
+    trendColor = COLOR_ORANGE;
+    timeText = "Unknown for: ";
+    break;
+  case HeaterTrend::STARTUP: // Nothing's drawn for it
+    break;
+  }
+
+  // printIn() only draws when the text changes, so these can be called every time.
+  if (heater.state == HeaterState::OFF)
+  {
+    // Display time of day
+    struct tm timeinfo;
+    if (!localTime(&timeinfo))
+    {
+      Serial.println("Failed to obtain time");
+      return;
+    }
+
+    char timeOfDay[9];
+    // format time of day h:mm am/pm
+    strftime(timeOfDay, 9, "%l:%M %p", &timeinfo);
+    dmaDisplay->setFont(&TomThumb); // Set font to small
+    dmaDisplay->printIn(bottomLine, TextAlign::RIGHT, 63, 31, COLOR_WHITE, "%s", timeOfDay);
+  }
+  else if (heater.state == HeaterState::STARTUP)
+  {
+    return;
+  }
+  else
+  {
+    dmaDisplay->setFont(&TomThumb);
+    dmaDisplay->printIn(bottomLine, TextAlign::LEFT, 0, 31, trendColor, "%s%s", timeText, durationStr);
+  }
+}
+
+// Accept a reading parsed to milliamps. Shared by /current, /cm and UDP. The history
+// and rollups are plug 0's. False if the queue was full and it was dropped: then the
+// monitor never sees it, so nothing else does either, and it's counted only as
+// queue_full.
+static bool acceptReading(uint8_t plug, int32_t mA, const char *via)
+{
+  uint64_t now = SystemClock::nowMs();
+  if (!readings.push({now, mA, (uint32_t)micros(), plug}))
+    return false;
+  if (mA != plugs.milliamps(plug))
+    Serial.printf("Plug %u reading via %s: %.3f\n", plug, via, mA / 1000.0f);
+  lastCurUpdate = now;
+  readingsAccepted++;
+  if (plug == 0)
+    recordReading(mA / 1000.0f, now);
+  return true;
+}
+
+// Plug reports are parsed straight out of the request buffer and answered with static
+// bodies, so they never touch the heap. /stats shows the per-route allocation count.
+// A plug that isn't plug 0 says which it is with &plug=N, on either route. A request
+// with no reading in it counts as a bad one: it's a plug that's misconfigured, and
+// should show up in heatplug_readings_rejected_total like one sending junk.
+void handleCommand(HttpRequest &request, HttpResponse &response)
+{
+  const char *cmnd = request.arg("cmnd");
+  const char *plugId = request.arg("plug");
+  int32_t mA;
+  uint8_t plug;
+  if (!cmnd)
+  {
+    readingsRejected++;
+    response.send(400, "text/plain", "No command provided\n");
+  }
+  else if (!parseCurrentCommand(cmnd, &mA, &plugId))
+  {
+    readingsRejected++;
+    response.send(400, "text/plain", "Invalid command\n");
+  }
+  else if (!parsePlug(plugId, PLUG_COUNT, &plug))
+  {
+    readingsBadPlug++;
+    response.send(400, "text/plain", "Bad plug id\n");
+  }
+  else
+  {
+    if (acceptReading(plug, mA, "cm"))
+      response.send(200, "text/plain", "Received\n");
+    else
+      response.send(503, "text/plain", "Too busy, reading dropped\n");
+  }
+}
+
+void handleCurrentReading(HttpRequest &request, HttpResponse &response)
+{
+  const char *value = request.arg("value");
+  int32_t mA;
+  uint8_t plug;
+  if (!value)
+  {
+    readingsRejected++;
+    response.send(400, "text/plain", "No current value provided\n");
+  }
+  else if (!parseMilliamps(value, &mA))
+  {
+    readingsRejected++;
+    response.send(400, "text/plain", "Bad current value\n");
+  }
+  else if (!parsePlug(request.arg("plug"), PLUG_COUNT, &plug))
+  {
+    readingsBadPlug++;
+    response.send(400, "text/plain", "Bad plug id\n");
+  }
+  else
+  {
+    if (acceptReading(plug, mA, "current"))
+      response.send(200, "text/plain", "Received\n");
+    else
+      response.send(503, "text/plain", "Too busy, reading dropped\n");
+  }
+}
+
+void handleUdpReading(const UdpReading &reading)
+{
+  if (reading.plug >= PLUG_COUNT)
+    readingsBadPlug++;
+  else
+    acceptReading(reading.plug, reading.milliamps, "udp"); // A drop's counted in the queue's stats
+}
+
+// /stats in sections, like /metrics: it's long outgrown one buffer. cursor[0] is the
+// next section. Counters first, then a line per route, then per timer on each task.
+#define STATS_ROUTE_SECTION 4
+#define STATS_TIMER_SECTION (STATS_ROUTE_SECTION + HTTP_MAX_ROUTES)
+#define STATS_HOST_SECTION (STATS_TIMER_SECTION + 2 * SCHEDULER_MAX_TIMERS)
+#define STATS_SECTIONS (STATS_HOST_SECTION + 1)
+static void writeStats(MetricsWriter &out, uint32_t section)
+{
+  if (section == 0)
+  {
+    const HttpStats &stats = server.stats();
+    out.value("requests", stats.requests);
+    out.value("bad_requests", stats.badRequests);
+    out.value("wrong_method_requests", stats.wrongMethod);
+    out.value("allocating_requests", stats.allocatingRequests);
+    out.value("connections_accepted", stats.accepted);
+    out.value("connections_evicted", stats.evicted);
+    out.value("connection_timeouts", stats.timeouts);
+    out.value("connections_active", stats.active);
+    out.value("connections_peak", stats.peakActive);
+    out.value("connections_kept_alive", stats.keptAlive);
+    out.value("requests_reused", stats.reusedRequests);
+    out.value("requests_pipelined", stats.pipelined);
+    out.value("connections_idle_closed", stats.idleClosed);
+    out.value("connections_closed_for_room", stats.closedForRoom);
+  }
+  else if (section == 1)
+  {
+    const UdpIngestStats &udp = udpIngest.stats();
+    const SampleQueueStats &queue = readings.stats();
+    out.value("udp_datagrams", udp.datagrams);
+    out.value("udp_accepted", udp.accepted);
+    out.value("udp_malformed", udp.malformed);
+    out.value("udp_duplicates", udp.duplicates);
+    out.value("udp_lost", udp.lost);
+    out.value("readings_queued", queue.pushed);
+    out.value("readings_dropped", queue.dropped);
+    out.value("reading_queue_overflows", queue.overflows);
+    out.value("reading_queue_peak", queue.peak);
+    out.value("readings_processed", queue.drained);
+    out.value("reading_batches", queue.batches);
+  }
+  else if (section == 2)
+  {
+    // The display counters belong to the render task. They're read here as they stand.
+    const PanelFlushStats &panel = dmaDisplay->flushStats();
+    out.value("display_frames", panel.frames);
+    out.value("display_pixels_last", panel.lastPixels);
+    out.value("display_pixels_peak", panel.peakPixels);
+    out.value("display_pixels_total", panel.totalPixels);
+    out.value("display_pixels_drawn", panel.drawnPixels);
+    out.value("display_flips", panel.flips);
+    out.value("display_double_buffered", dmaDisplay->doubleBuffered());
+    out.value("display_dma_bytes", dmaDisplay->dmaBytes());
+    out.value("display_shadow_bytes", dmaDisplay->shadowBytes());
+    out.value("display_text_drawn", dmaDisplay->textStats().drawn);
+    out.value("display_text_skipped", dmaDisplay->textStats().skipped);
+  }
+  else if (section == 3)
+  {
+    const SchedulerStats &ingest = ingestScheduler.stats();
+    const SchedulerStats &render = renderScheduler.stats();
+    out.value("uptime_ms", SystemClock::nowMs());
+    out.value("ingest_wakeups", ingest.wakeups);
+    out.value("ingest_awake_us", ingest.awakeUs);
+    out.value("ingest_asleep_us", ingest.asleepUs);
+    out.value("ingest_stack_free", uxTaskGetStackHighWaterMark(ingestHandle));
+    out.value("render_wakeups", render.wakeups);
+    out.value("render_awake_us", render.awakeUs);
+    out.value("render_asleep_us", render.asleepUs);
+    out.value("render_stack_free", uxTaskGetStackHighWaterMark(renderHandle));
+    out.value("snapshot_retries", snapshotRetries.load());
+    out.value("plugs_active", __builtin_popcount(plugs.activeMask()));
+  }
+  else if (section < STATS_TIMER_SECTION)
+  {
+    uint8_t i = section - STATS_ROUTE_SECTION;
+    if (i < server.routeCount())
+      out.append("%s hits %u allocations %u\n", server.route(i).path, server.route(i).hits, server.route(i).allocations);
+  }
+  else if (section < STATS_HOST_SECTION)
+  {
+    uint8_t i = (section - STATS_TIMER_SECTION) % SCHEDULER_MAX_TIMERS;
+    const Scheduler &scheduler = section < STATS_TIMER_SECTION + SCHEDULER_MAX_TIMERS ? ingestScheduler : renderScheduler;
+    if (i < scheduler.timerCount())
+      out.append("timer %s runs %u worst_late_ms %u\n", scheduler.timer(i).name, scheduler.timer(i).runs, scheduler.timer(i).worstLateMs);
+  }
+  else
+  {
+#ifndef ARDUINO_ARCH_ESP32
+    // CPU time on the host, so test/load_gen.py can work out what a reading cost: the
+    // ingest thread's, and everything's.
+    out.value("cpu_us", nativeThreadCpuUs());
+    out.value("process_cpu_us", nativeProcessCpuUs());
+#endif
+  }
+}
+
+static size_t fillStats(HttpResponse &response, uint8_t *buf, size_t size)
+{
+  MetricsWriter out(buf, size);
+  uint32_t &section = response.cursor[0];
+  for (; section < STATS_SECTIONS; section++)
+  {
+    size_t mark = out.length();
+    writeStats(out, section);
+    if (out.overflowed())
+    {
+      out.rewind(mark);
+      break;
+    }
+  }
+  return out.length();
+}
+
+void handleStats(HttpRequest &, HttpResponse &response)
+{
+  response.beginStream(200, "text/plain", HTTP_CONTENT_LENGTH_UNKNOWN, fillStats);
+  response.cursor[0] = 0;
+}
+
+// cursor[0] is the next stage, cursor[1] whether to zero them as they're read.
+static size_t fillProfile(HttpResponse &response, uint8_t *buf, size_t size)
+{
+  uint32_t &next = response.cursor[0];
+  size_t len = 0;
+  while (next < sizeof(profileStages) / sizeof(profileStages[0]) && size - len > PROFILE_LINE_MAX)
+    len += profileStages[next++]->describe((char *)buf + len, size - len, response.cursor[1]);
+  return len;
+}
+
+// /profile -> a line per stage, see Profiler.hpp. /profile?reset=1 zeroes each stage
+// as it's read, so the next read covers just the time between.
+void handleProfile(HttpRequest &request, HttpResponse &response)
+{
+  response.beginStream(200, "text/plain", HTTP_CONTENT_LENGTH_UNKNOWN, fillProfile);
+  response.cursor[0] = 0;
+  response.cursor[1] = request.hasArg("reset");
+}
+
+// /metrics in sections, see MetricsWriter.hpp. cursor[0] is the next one. A section
+// per plug for its state, then one per plug for its trend, so each metric's lines stay
+// together and no section outgrows a buffer however many plugs there are.
+#define METRICS_STATE_SECTION 0
+#define METRICS_TREND_SECTION PLUG_COUNT
+#define METRICS_OTHER_SECTION (2 * PLUG_COUNT)
+static void writeMetrics(MetricsWriter &out, uint32_t section)
+{
+  if (section < METRICS_OTHER_SECTION)
+  {
+    uint8_t plug = section % PLUG_COUNT;
+    if (!plugs.active(plug))
+      return;
+    char id[4];
+    snprintf(id, sizeof(id), "%u", plug);
+    if (section < METRICS_TREND_SECTION)
+    {
+      if (plug == 0)
+        out.help("heatplug_state", "gauge", "Heater state, 1 for the one it's in");
+      for (int i = 0; i < (int)(sizeof(heaterStateNames) / sizeof(heaterStateNames[0])); i++)
+        out.value("heatplug_state", "plug", id, "state", heaterStateNames[i], (int)plugs.state(plug) == i);
+    }
+    else
+    {
+      if (plug == 0)
+        out.help("heatplug_trend", "gauge", "Heater trend, 1 for the one it's in");
+      for (int i = 0; i < (int)(sizeof(heaterTrendNames) / sizeof(heaterTrendNames[0])); i++)
+        out.value("heatplug_trend", "plug", id, "trend", heaterTrendNames[i], (int)plugs.trend(plug) == i);
+    }
+    return;
+  }
+
+  switch (section - METRICS_OTHER_SECTION)
+  {
+  case 0:
+  {
+    const UdpIngestStats &udp = udpIngest.stats();
+    out.help("heatplug_readings_received_total", "counter", "Readings that arrived over HTTP or UDP, good or not");
+    out.value("heatplug_readings_received_total",
+              readingsAccepted + readingsRejected + readingsBadPlug + udp.malformed + readings.stats().dropped);
+    out.help("heatplug_readings_rejected_total", "counter", "Readings not passed to the monitor");
+    out.value("heatplug_readings_rejected_total", "reason", "bad_value", readingsRejected);
+    out.value("heatplug_readings_rejected_total", "reason", "malformed_udp", udp.malformed);
+    out.value("heatplug_readings_rejected_total", "reason", "queue_full", readings.stats().dropped);
+    out.value("heatplug_readings_rejected_total", "reason", "bad_plug", readingsBadPlug);
+    if (lastCurUpdate)
+    {
+      out.help("heatplug_last_reading_age_seconds", "gauge", "Time since the last reading");
+      out.decimal("heatplug_last_reading_age_seconds", (SystemClock::nowMs() - lastCurUpdate) / 1000.0);
+    }
+    break;
+  }
+  case 1:
+#ifdef ARDUINO_ARCH_ESP32 // The host's heap is nothing like it
+    out.help("heatplug_heap_free_bytes", "gauge", "Free heap");
+    out.value("heatplug_heap_free_bytes", ESP.getFreeHeap());
+    out.help("heatplug_heap_min_free_bytes", "gauge", "Least free heap since boot");
+    out.value("heatplug_heap_min_free_bytes", ESP.getMinFreeHeap());
+    out.help("heatplug_heap_largest_free_block_bytes", "gauge", "Largest block that can be allocated");
+    out.value("heatplug_heap_largest_free_block_bytes", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+#endif
+    break;
+  case 2:
+    out.histogram("heatplug_reading_to_display_seconds",
+                  "From a reading arriving to the panel frame showing the change it made", readingToDisplay);
+    break;
+  }
+}
+#define METRICS_SECTIONS (METRICS_OTHER_SECTION + 3)
+
+static size_t fillMetrics(HttpResponse &response, uint8_t *buf, size_t size)
+{
+  MetricsWriter out(buf, size);
+  uint32_t &section = response.cursor[0];
+  for (; section < METRICS_SECTIONS; section++)
+  {
+    size_t mark = out.length();
+    writeMetrics(out, section);
+    if (out.overflowed())
+    {
+      out.rewind(mark);
+      break;
+    }
+  }
+  return out.length();
+}
+
+// Prometheus text format, streamed so a scrape doesn't touch the heap.
+void handleMetrics(HttpRequest &, HttpResponse &response)
+{
+  response.beginStream(200, "text/plain; version=0.0.4", HTTP_CONTENT_LENGTH_UNKNOWN, fillMetrics);
+  response.cursor[0] = 0;
+}
+
+void handleNotFound(HttpRequest &request, HttpResponse &response)
+{
+  Serial.printf("URI: %s\nMethod: %s\nArguments: %u", request.path(), request.method(), request.args());
+  for (uint8_t i = 0; i < request.args(); i++)
+    Serial.printf("\n%s: %s", request.argName(i), request.argValue(i));
+  Serial.println();
+  response.send(404, "text/plain", "Not found\n");
+}
+
+// Everything that keeps a record of readings. Called once per accepted reading.
+void recordReading(float amps, uint64_t when)
+{
+  uint16_t units = currentToUnits(amps);
+  history.add(when, units);
+  rollups.add(when, units);
+}
+
+// Raw dump of the history ring: a HistoryHeader then count 16-bit little endian
+// samples, oldest first. See SampleHistory.hpp for the encoding. The samples are
+// pulled from the ring a buffer at a time as the client takes them.
+static size_t fillHistory(HttpResponse &response, uint8_t *buf, size_t size)
+{
+  uint32_t &seq = response.cursor[0];
+  uint32_t end = response.cursor[1];
+  uint32_t n = history.copy(seq, (uint16_t *)buf, min((uint32_t)(size / sizeof(uint16_t)), end - seq));
+  seq += n;
+  return n * sizeof(uint16_t);
+}
+
+void handleHistory(HttpRequest &, HttpResponse &response)
+{
+  HistoryHeader header;
+  time_t now = time(nullptr);
+  history.header(header, SystemClock::nowMs(), now > 1600000000 ? (uint32_t)now : 0);
+
+  response.beginStream(200, "application/octet-stream", sizeof(header) + header.count * sizeof(uint16_t), fillHistory);
+  response.write(&header, sizeof(header));
+  response.cursor[0] = history.firstSeq();
+  response.cursor[1] = history.endSeq();
+}
+
+// cursor[0] is how many buckets are left to send, cursor[1] the tier.
+static size_t fillRollup(HttpResponse &response, uint8_t *buf, size_t size)
+{
+  const float scale = HISTORY_MA_PER_UNIT / 1000.0f;
+  uint32_t &left = response.cursor[0];
+  uint32_t res = response.cursor[1];
+  size_t len = 0;
+  while (left && size - len > 64)
+  {
+    const RollupBucket &b = rollups.newest(res, --left);
+    len += snprintf((char *)buf + len, size - len, "%u,%.2f,%.2f,%.3f,%u\n", b.startS, b.minU * scale, b.maxU * scale,
+                    b.count ? (float)b.sum / b.count * scale : 0.0f, b.count);
+  }
+  return len;
+}
+
+// /rollup?res=60&n=60 -> the last n buckets of the 1s, 60s or 3600s tier as CSV,
+// oldest first. Times are SystemClock seconds, like /history.
+void handleRollup(HttpRequest &request, HttpResponse &response)
+{
+  uint32_t res = request.hasArg("res") ? strtoul(request.arg("res"), nullptr, 10) : 60;
+  uint32_t n = request.hasArg("n") ? strtoul(request.arg("n"), nullptr, 10) : 60;
+
+  if (!rollups.hasTier(res))
+  {
+    response.send(400, "text/plain", "res must be 1, 60 or 3600\n");
+    return;
+  }
+
+  response.beginStream(200, "text/csv", HTTP_CONTENT_LENGTH_UNKNOWN, fillRollup);
+  response.write("start_s,min_a,max_a,mean_a,count\n");
+  response.cursor[0] = min(n, rollups.count(res));
+  response.cursor[1] = res;
+}
+
+// While the clock isn't set there's no telling, so leave the display on.
+bool shouldDisplayBeOn()
+{
+  time_t now = time(nullptr);
+  if (now < 1600000000)
+    return true;
+  struct tm local;
+  localtime_r(&now, &local);
+  return schedule.on(local.tm_wday, local.tm_hour, local.tm_min);
+}
+
+// The saved schedule if there is one, else the built-in one. Before the tasks start.
+void loadSchedule()
+{
+  WeekSchedule loaded = defaultSchedule;
+  prefs.begin(SCHEDULE_NVS_NAMESPACE, true);
+  if (prefs.getBytesLength(SCHEDULE_NVS_KEY) == sizeof(loaded))
+  {
+    prefs.getBytes(SCHEDULE_NVS_KEY, &loaded, sizeof(loaded));
+    Serial.println("Display schedule from NVS");
+  }
+  prefs.end();
+  scheduleState.write(loaded);
+}
+
+// GET /schedule shows the schedule, /schedule?set=mon-fri 08:00-22:00,... replaces it
+// and /schedule?reset=1 goes back to the built-in one. Either is saved to NVS and the
+// display follows straight away.
+void handleSchedule(HttpRequest &request, HttpResponse &response)
+{
+  static WeekSchedule updated; // 1.2KB, and the seqlock puts another copy on the stack
+  const char *set = request.arg("set");
+  if (set)
+  {
+    if (!parseSchedule(set, &updated))
+    {
+      response.send(400, "text/plain", "Bad schedule. Expected e.g. mon-fri 08:00-22:00,sat 10:00-18:00\n");
+      return;
+    }
+    prefs.begin(SCHEDULE_NVS_NAMESPACE, false);
+    bool saved = prefs.putBytes(SCHEDULE_NVS_KEY, &updated, sizeof(updated)) == sizeof(updated);
+    prefs.end();
+    if (!saved)
+      Serial.println("Couldn't save the display schedule");
+    scheduleState.write(updated);
+    xTaskNotifyGive(renderHandle);
+  }
+  else if (request.hasArg("reset"))
+  {
+    prefs.begin(SCHEDULE_NVS_NAMESPACE, false);
+    prefs.remove(SCHEDULE_NVS_KEY);
+    prefs.end();
+    updated = defaultSchedule;
+    scheduleState.write(updated);
+    xTaskNotifyGive(renderHandle);
+  }
+  else
+    scheduleState.read(updated);
+
+  char body[768];
+  size_t len = updated.describe(body, sizeof(body));
+  if (!len)
+    len = snprintf(body, sizeof(body), "never\n");
+  response.send(200, "text/plain", body, len);
+}
+
+void signRoutes()
+{
+  server.on("/cm", HttpMethod::GET, handleCommand);
+  server.on("/current", HttpMethod::GET, handleCurrentReading);
+  server.on("/history", HttpMethod::GET, handleHistory);
+  server.on("/rollup", HttpMethod::GET, handleRollup);
+  server.on("/metrics", HttpMethod::GET, handleMetrics);
+  server.on("/profile", HttpMethod::GET, handleProfile);
+  server.on("/schedule", HttpMethod::GET, handleSchedule);
+  server.on("/stats", HttpMethod::GET, handleStats);
+  server.onNotFound(handleNotFound);
+}
+
+bool signListen(uint16_t httpPort, uint16_t udpPort)
+{
+  bool listening = server.begin(httpPort);
+  if (!listening)
+    Serial.println("HTTP server failed to start");
+  if (!udpIngest.begin(udpPort, handleUdpReading))
+    Serial.println("UDP ingest failed to start");
+  server.wakeOn(udpIngest.fd());
+  return listening;
+}
+
+void signStartTasks()
+{
+  static SignSnapshot first = {};
+  snapshotPlugs(first);
+  signState.write(first);
+  xTaskCreatePinnedToCore(renderTask, "render", RENDER_STACK, nullptr, 1, &renderHandle, RENDER_CORE);
+  xTaskCreatePinnedToCore(ingestTask, "ingest", INGEST_STACK, nullptr, 1, &ingestHandle, INGEST_CORE);
+}
+
+void signStop()
+{
+  stopping = true;
+}
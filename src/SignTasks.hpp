@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include "HttpServer.hpp"
+#include "MatrixPanel_CC.h"
+#include "MonotonicClock.hpp"
+#include "PlugTable.hpp"
+#include "SampleHistory.hpp"
+#include "Scheduler.hpp"
+#include "UdpIngest.hpp"
+
+// The sign itself: the reading handlers, /stats, /metrics and the rest of the routes,
+// the ingest and render tasks, and what render draws. Built into the firmware
+// (main.cpp) and the host sim (native/sim.cpp) as the same translation unit, so the
+// sim can't drift from what the sign does. What only one of them has stays with it:
+// WiFi, NTP at boot and /clients in main.cpp, the panel's pins, and sockets on
+// localhost and /sim/reset in sim.cpp. The rest of the difference is NativeShim's, or
+// behind ARDUINO_ARCH_ESP32 here.
+
+#define PLUG_COUNT 16
+#define HISTORY_CAPACITY (24 * 60 * 60) // 24 hours at 1 Hz. 2 bytes each.
+#define SAMPLE_BATCH 32                 // Most readings the monitor takes per pass
+#define TIMER_TICK_MS 200               // Timer line redraws while it's showing
+#define PAGE_MS 5000                    // How long each plug is shown when there's more than one
+
+typedef PlugTable<SystemClock, PLUG_COUNT> SignPlugs;
+
+// The firmware runs with these as they are. The host tools change them.
+struct SignOptions
+{
+  uint32_t timerTickMs = TIMER_TICK_MS;
+  uint32_t batch = SAMPLE_BATCH;
+  uint32_t pageMs = PAGE_MS; // 0 keeps plug 0 on the panel
+  uint32_t pollMs = 0;       // Non-zero: both tasks wake on a fixed delay, like the old loop
+  // Called on render after each flush that sent any pixels, with the frame the panel
+  // now shows.
+  void (*onFrame)(const uint16_t *frame) = nullptr;
+};
+
+extern SignOptions signOptions;
+extern HttpServer server;
+extern UdpIngest udpIngest;
+extern SignPlugs plugs; // Owned by ingest
+extern SampleHistory<HISTORY_CAPACITY> history;
+extern Scheduler ingestScheduler;
+extern Scheduler renderScheduler;
+extern MatrixPanel_CC *dmaDisplay; // Whoever builds this sets it up, before signStartTasks()
+
+// The display schedule from NVS, or the built-in one. Before the tasks start.
+void loadSchedule();
+// Every route but /clients, which is the platform's.
+void signRoutes();
+// HTTP and UDP readings. False if HTTP can't listen.
+bool signListen(uint16_t httpPort, uint16_t udpPort);
+// Render first, so ingest has it to wake.
+void signStartTasks();
+// Both tasks finish within a second. Safe from a signal handler.
+void signStop();
+// Hand render a new snapshot, and wake it, if anything it shows has changed. Ingest only.
+void publishSignState(uint32_t readingUs = 0);
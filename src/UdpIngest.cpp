@@ -0,0 +1,129 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include "lwip/sockets.h"
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
+
+#include "UdpIngest.hpp"
+#include "ParseCurrent.hpp"
+
+bool UdpIngest::begin(uint16_t port, UdpReadingHandler handler)
+{
+    _handler = handler;
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_fd < 0)
+        return false;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+    fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+}
+
+// A current a plug could report: not negative, and no more than the text form can
+// carry. The binary form isn't parsed, so it has to be checked here.
+static bool plausibleMilliamps(int32_t mA)
+{
+    return mA >= 0 && mA <= PARSE_MAX_AMPS * 1000;
+}
+
+bool UdpIngest::decode(const uint8_t *data, size_t len, UdpReading &reading)
+{
+    if (len == sizeof(UdpReadingPacket) && data[0] == 'H' && data[1] == 'P' && data[2] == 1)
+    {
+        UdpReadingPacket packet;
+        memcpy(&packet, data, sizeof(packet));
+        if (!plausibleMilliamps(packet.milliamps))
+            return false;
+        reading.plug = packet.plug;
+        reading.seq = packet.seq;
+        reading.milliamps = packet.milliamps;
+        return true;
+    }
+
+    char text[48];
+    if (len < 4 || len >= sizeof(text) || memcmp(data, "HP1 ", 4))
+        return false;
+    memcpy(text, data, len);
+    text[len] = 0;
+
+    char *p = text + 4;
+    char *end;
+    unsigned long plug = strtoul(p, &end, 10);
+    if (end == p || *end != ' ' || plug > 255)
+        return false;
+    p = end + 1;
+    unsigned long seq = strtoul(p, &end, 10);
+    if (end == p || *end != ' ')
+        return false;
+    if (!parseMilliamps(end + 1, &reading.milliamps) || !plausibleMilliamps(reading.milliamps))
+        return false;
+    reading.plug = plug;
+    reading.seq = seq;
+    return true;
+}
+
+bool UdpIngest::inSequence(const UdpReading &reading)
+{
+    if (reading.plug >= UDP_MAX_PLUGS)
+        return true; // Nowhere to track it. Take it as it comes.
+
+    uint32_t &last = _lastSeq[reading.plug];
+    if (_seen[reading.plug])
+    {
+        int32_t ahead = (int32_t)(reading.seq - last);
+        if (ahead <= 0 && ahead > -UDP_RESTART_WINDOW)
+        {
+            _stats.duplicates++;
+            return false;
+        }
+        if (ahead > 1)
+            _stats.lost += ahead - 1;
+    }
+    _seen[reading.plug] = true;
+    last = reading.seq;
+    return true;
+}
+
+void UdpIngest::poll()
+{
+    if (_fd < 0)
+        return;
+
+    uint8_t buf[64];
+    for (int i = 0; i < UDP_MAX_PER_POLL; i++)
+    {
+        int n = recv(_fd, buf, sizeof(buf), 0);
+        if (n < 0)
+            return; // EAGAIN: nothing more waiting
+        _stats.datagrams++;
+
+        UdpReading reading;
+        if (!decode(buf, n, reading))
+        {
+            _stats.malformed++;
+            continue;
+        }
+        if (!inSequence(reading))
+            continue;
+        _stats.accepted++;
+        if (_handler)
+            _handler(reading);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Plug readings over UDP. A reading is 4 bytes of information; wrapping it in a TCP
+// connection plus an HTTP request and response costs far more than the reading.
+// Here it's one datagram in, nothing back.
+//
+// Two datagram formats, both carrying plug id, sequence number and value:
+//   binary  UdpReadingPacket below, 12 bytes, little endian
+//   text    "HP1 <plug> <seq> <amps>", e.g. "HP1 0 1234 12.345"
+// Sequence numbers let us drop duplicates and reordered packets and count losses.
+// A plug that restarts its numbering is picked up again rather than ignored.
+
+#define UDP_INGEST_PORT 4210
+#define UDP_MAX_PLUGS 16
+#define UDP_MAX_PER_POLL 16     // Datagrams handled per poll(), so a flood can't starve loop()
+#define UDP_RESTART_WINDOW 1000 // A sequence this far backwards means the plug restarted
+
+struct __attribute__((packed)) UdpReadingPacket
+{
+    char magic[2];    // "HP"
+    uint8_t version;  // 1
+    uint8_t plug;
+    uint32_t seq;
+    int32_t milliamps;
+};
+
+struct UdpReading
+{
+    uint8_t plug;
+    uint32_t seq;
+    int32_t milliamps;
+};
+
+struct UdpIngestStats
+{
+    uint32_t datagrams;
+    uint32_t accepted;
+    uint32_t malformed;
+    uint32_t duplicates; // Repeated or arrived after a later one
+    uint32_t lost;       // Gaps in the sequence
+};
+
+typedef void (*UdpReadingHandler)(const UdpReading &reading);
+
+class UdpIngest
+{
+private:
+    int _fd = -1;
+    UdpReadingHandler _handler = nullptr;
+    UdpIngestStats _stats = {};
+    uint32_t _lastSeq[UDP_MAX_PLUGS];
+    bool _seen[UDP_MAX_PLUGS] = {};
+
+    bool inSequence(const UdpReading &reading);
+
+public:
+    bool begin(uint16_t port, UdpReadingHandler handler);
+
+    // Handle whatever has arrived, without waiting. Call from loop().
+    void poll();
+
+    // The socket, to wait on alongside others. -1 before begin().
+    int fd() const { return _fd; }
+
+    // Either format. False if it's neither, or the current is negative or over
+    // PARSE_MAX_AMPS.
+    static bool decode(const uint8_t *data, size_t len, UdpReading &reading);
+
+    const UdpIngestStats &stats() const { return _stats; }
+};
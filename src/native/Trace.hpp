@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// A trace is the same "current, duration" format PlugMock.py reads from test/input.txt.
+// current == -1 means the plug stops reporting for that long (lost connection).
+struct TraceStep
+{
+    float current;
+    float durationS;
+};
+
+inline bool loadTrace(const char *path, std::vector<TraceStep> &steps)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+    {
+        TraceStep step;
+        if (sscanf(line, " %f , %f", &step.current, &step.durationS) == 2)
+            steps.push_back(step);
+    }
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,470 @@
+// Microbenchmarks for the ingest-to-state hot path, on the host.
+//
+//   pio run -e native_bench && .pio/build/native_bench/program --samples 2000000 --seed 1 > bench.jsonl
+//
+// Each bench runs twice over the same seeded samples: once untimed-per-call for
+// throughput, once with a timestamp around every call for p50/p99. One JSON object
+// per bench goes to stdout so runs can be diffed between commits
+// (test/bench_compare.py); the human readable table goes to stderr.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <Arduino.h>
+#include "../DisplaySchedule.hpp"
+#include "../HeaterState.hpp"
+#include "../PlugTable.hpp"
+#include "../Profiler.hpp"
+#include "MatrixPanel_CC.h"
+#include "TomThumbCAC.h"
+#include "ImpactFull12.h"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static volatile float sinkF;
+
+struct BenchResult
+{
+    double nsPerOp;
+    double p50Ns;
+    double p99Ns;
+    double maxNs;
+};
+
+// Cost of the two clock reads around each timed call, subtracted from the latencies.
+static double timerOverheadNs()
+{
+    const int n = 100000;
+    std::vector<double> v(n);
+    for (int i = 0; i < n; i++)
+    {
+        auto t0 = BenchClock::now();
+        auto t1 = BenchClock::now();
+        v[i] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+    std::nth_element(v.begin(), v.begin() + n / 2, v.end());
+    return v[n / 2];
+}
+
+template <typename Setup, typename Op>
+static BenchResult runBench(size_t n, Setup setup, Op op, double overheadNs)
+{
+    BenchResult r;
+
+    setup();
+    auto t0 = BenchClock::now();
+    for (size_t i = 0; i < n; i++)
+        op(i);
+    r.nsPerOp = std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / n;
+
+    std::vector<float> lat(n);
+    setup();
+    for (size_t i = 0; i < n; i++)
+    {
+        auto a = BenchClock::now();
+        op(i);
+        auto b = BenchClock::now();
+        lat[i] = std::max(0.0, std::chrono::duration<double, std::nano>(b - a).count() - overheadNs);
+    }
+    std::nth_element(lat.begin(), lat.begin() + n / 2, lat.end());
+    r.p50Ns = lat[n / 2];
+    std::nth_element(lat.begin(), lat.begin() + (n * 99) / 100, lat.end());
+    r.p99Ns = lat[(n * 99) / 100];
+    r.maxNs = *std::max_element(lat.begin() + (n * 99) / 100, lat.end());
+    return r;
+}
+
+static void report(const char *name, size_t n, unsigned seed, const BenchResult &r)
+{
+    fprintf(stderr, "%-24s %10.1f ns/op %12.0f ops/s   p50 %8.1f ns   p99 %8.1f ns   max %10.1f ns\n",
+            name, r.nsPerOp, 1e9 / r.nsPerOp, r.p50Ns, r.p99Ns, r.maxNs);
+    printf("{\"bench\":\"%s\",\"samples\":%zu,\"seed\":%u,\"ns_per_op\":%.2f,\"ops_per_s\":%.0f,"
+           "\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"max_ns\":%.2f}\n",
+           name, n, seed, r.nsPerOp, 1e9 / r.nsPerOp, r.p50Ns, r.p99Ns, r.maxNs);
+    fflush(stdout);
+}
+
+// Synthetic plug readings: mostly sitting at one of the heater's levels with a bit
+// of noise, and switching level now and then. Roughly what a day of traces looks like.
+static std::vector<float> makeSamples(size_t n, unsigned seed)
+{
+    static const float levels[] = {0.0f, 0.14f, 7.5f, 12.5f};
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> level(0, 3);
+    std::uniform_int_distribution<int> hold(5, 600);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+
+    std::vector<float> v(n);
+    size_t i = 0;
+    while (i < n)
+    {
+        float base = levels[level(rng)];
+        for (int k = hold(rng); k > 0 && i < n; k--)
+            v[i++] = base == 0.0f ? 0.0f : base + noise(rng);
+    }
+    return v;
+}
+
+// HeaterMonitor::update() as it was before the rules were a table (HeaterState.hpp),
+// the switch on the state, for checking the table against and timing it. Profile
+// fields stand in for the #defines it used; it logs the same.
+template <const HeaterProfile &P>
+static void switchUpdate(const HeaterFields &h, float powerReading, uint64_t updateTime)
+{
+    auto setState = [&](HeaterState state, uint64_t at)
+    {
+        if (state != h.state)
+        {
+            h.state = state;
+            h.stateSinceMs = at;
+            Serial.printf("State: %d @ %llu\n", (int)state, (unsigned long long)at);
+        }
+    };
+    auto setTrend = [&](HeaterTrend trend)
+    {
+        if (trend != h.trend)
+        {
+            h.trendSinceMs = VirtualClock::nowMs();
+            h.trend = trend;
+            Serial.printf("Trend: %d @ %llu\n", (int)trend, (unsigned long long)h.trendSinceMs);
+        }
+    };
+
+    if (VirtualClock::nowMs() - updateTime > P.lostConnectionMs)
+    {
+        setState(HeaterState::UNKNOWN, updateTime);
+        setTrend(HeaterTrend::UNKNOWN);
+        h.unknown = true;
+        return;
+    }
+    h.unknown = false;
+
+    if (powerReading >= P.heatingCurrentA)
+        setTrend(HeaterTrend::HEATING);
+    else if (powerReading >= P.maintainingCurrentA)
+        setTrend(HeaterTrend::MAINTAINING);
+    else if (h.state == HeaterState::COOL || h.state == HeaterState::OFF)
+        setTrend(HeaterTrend::IDLE);
+    else
+        setTrend(HeaterTrend::COOLING);
+
+    switch (h.state)
+    {
+    case HeaterState::STARTUP:
+        if (powerReading > P.offCurrentA)
+            setState(HeaterState::HOT, updateTime);
+        else if (updateTime - h.stateSinceMs > P.startupTimeoutMs)
+            setState(HeaterState::OFF, VirtualClock::nowMs());
+        break;
+    case HeaterState::OFF:
+    case HeaterState::COOL:
+        if (powerReading > P.heatingCurrentA)
+            setState(HeaterState::WARM, updateTime);
+        else if (powerReading >= P.maintainingCurrentA)
+        {
+            setState(HeaterState::HOT, updateTime);
+            Serial.printf("Unexpected power reading in state %d: %f\n", (int)h.state, powerReading);
+        }
+        else if (updateTime - h.stateSinceMs > P.coolToOffMs)
+            setState(HeaterState::OFF, updateTime);
+        break;
+    case HeaterState::WARM:
+        if (h.trend == HeaterTrend::MAINTAINING)
+            setState(HeaterState::HOT, updateTime);
+        else if (h.trend == HeaterTrend::HEATING && updateTime - h.stateSinceMs > P.warmToHotMs)
+            setState(HeaterState::HOT, updateTime);
+        else if (h.trend == HeaterTrend::COOLING && updateTime - h.stateSinceMs > P.warmToCoolMs)
+            setState(HeaterState::COOL, updateTime);
+        break;
+    case HeaterState::HOT:
+        if (h.trend == HeaterTrend::COOLING && updateTime - h.stateSinceMs > P.hotToWarmMs)
+            setState(HeaterState::WARM, updateTime);
+        break;
+    case HeaterState::UNKNOWN:
+        setState(HeaterState::STARTUP, updateTime);
+        break;
+    }
+}
+
+// The switch and the table over the same readings, field for field after every
+// update. Readings land on the profile's thresholds now and then, arrive late, and
+// stop for long enough to lose the connection. False, and says where, if they differ.
+template <const HeaterProfile &P>
+static bool tableMatchesSwitch(const std::vector<float> &samples, unsigned seed, const char *name)
+{
+    const float edges[] = {0.0f, (float)P.maintainingCurrentA, (float)P.heatingCurrentA, 0.001f};
+    std::mt19937 rng(seed);
+    HeaterState states[2] = {HeaterState::STARTUP, HeaterState::STARTUP};
+    HeaterTrend trends[2] = {HeaterTrend::UNKNOWN, HeaterTrend::UNKNOWN};
+    uint64_t stateSince[2] = {}, trendSince[2] = {};
+    bool unknown[2] = {};
+    HeaterFields a = {states[0], trends[0], stateSince[0], trendSince[0], unknown[0]};
+    HeaterFields b = {states[1], trends[1], stateSince[1], trendSince[1], unknown[1]};
+    uint64_t readingMs = 0;
+    VirtualClock::set(0);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        uint32_t r = rng();
+        VirtualClock::advance(r % 64 == 0 ? P.lostConnectionMs + 1000 : (r >> 8) % 3000);
+        if (r % 4)
+            readingMs = VirtualClock::nowMs() - (r >> 20) % 2000;
+        float reading = r % 16 == 1 ? edges[(r >> 4) % 4] : samples[i];
+        switchUpdate<P>(a, reading, readingMs);
+        BasicHeaterMonitor<VirtualClock, P>::update(b, reading, readingMs);
+        if (states[0] != states[1] || trends[0] != trends[1] || stateSince[0] != stateSince[1] ||
+            trendSince[0] != trendSince[1] || unknown[0] != unknown[1])
+        {
+            fprintf(stderr, "bench: %s table disagrees with the switch at sample %zu (%f): state %d/%d trend %d/%d\n",
+                    name, i, reading, (int)states[0], (int)states[1], (int)trends[0], (int)trends[1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = 2000000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--samples") && i + 1 < argc)
+            n = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: bench [--samples N] [--seed S]\n");
+            return 2;
+        }
+    }
+    if (n < 100)
+        n = 100;
+
+    std::vector<float> samples = makeSamples(n, seed);
+    std::vector<String> wire(n);
+    for (size_t i = 0; i < n; i++)
+        wire[i] = String(samples[i], 3); // What Tasmota puts in ?value=
+
+    double overhead = timerOverheadNs();
+    fprintf(stderr, "bench: %zu samples, seed %u, timer overhead %.1f ns\n", n, seed, overhead);
+
+    BasicHeaterMonitor<VirtualClock> monitor;
+    auto resetMonitor = [&]()
+    {
+        monitor = BasicHeaterMonitor<VirtualClock>();
+        VirtualClock::set(0);
+    };
+
+    // State machine only. Serial muted so logging on transitions doesn't count here.
+    Serial.setOutput(nullptr);
+    report("update", n, seed, runBench(n, resetMonitor, [&](size_t i)
+                                       {
+        VirtualClock::advance(500);
+        monitor.update(samples[i], VirtualClock::nowMs()); }, overhead));
+
+    // The same through the old switch, after checking it and the rule table agree on
+    // both profiles.
+    if (!tableMatchesSwitch<fieldProfile>(samples, seed, "field") ||
+        !tableMatchesSwitch<homeTestingProfile>(samples, seed, "home testing"))
+        return 1;
+    HeaterState switchState = HeaterState::STARTUP;
+    HeaterTrend switchTrend = HeaterTrend::UNKNOWN;
+    uint64_t switchStateSince = 0, switchTrendSince = 0;
+    bool switchUnknown = false;
+    HeaterFields switchFields = {switchState, switchTrend, switchStateSince, switchTrendSince, switchUnknown};
+    report("update_switch", n, seed, runBench(n, [&]()
+                                              {
+        switchState = HeaterState::STARTUP;
+        switchTrend = HeaterTrend::UNKNOWN;
+        switchStateSince = switchTrendSince = 0;
+        VirtualClock::set(0); }, [&](size_t i)
+                                              {
+        VirtualClock::advance(500);
+        switchUpdate<fieldProfile>(switchFields, samples[i], VirtualClock::nowMs()); }, overhead));
+
+    // What handleCurrentReading() does with the argument: a String copy, then toFloat() twice.
+    double lastReading = -1.0;
+    report("parse_string_tofloat", n, seed, runBench(n, [&]()
+                                                     { lastReading = -1.0; }, [&](size_t i)
+                                                     {
+        String current = wire[i];
+        if (current.toFloat() != lastReading)
+            lastReading = current.toFloat();
+        sinkF = lastReading; }, overhead));
+
+    // Logging. Alternate heating/maintaining so every update changes trend and logs,
+    // with Serial writing to /dev/null so formatting and the write are both paid.
+    FILE *devnull = fopen("/dev/null", "w");
+    Serial.setOutput(devnull);
+    report("update_logging_trend", n, seed, runBench(n, resetMonitor, [&](size_t i)
+                                                     {
+        VirtualClock::advance(500);
+        monitor.update((i & 1) ? 12.5f : 7.5f, VirtualClock::nowMs()); }, overhead));
+    // Same again with Serial muted: printf still formats, it just doesn't write.
+    Serial.setOutput(nullptr);
+    report("update_format_trend", n, seed, runBench(n, resetMonitor, [&](size_t i)
+                                                   {
+        VirtualClock::advance(500);
+        monitor.update((i & 1) ? 12.5f : 7.5f, VirtualClock::nowMs()); }, overhead));
+    if (devnull)
+        fclose(devnull);
+
+    // Sixteen plugs: a reading each per pass, then the liveness pass over all of them.
+    // As an array of monitors, and as PlugTable's columns.
+    static const size_t plugCount = 16;
+    BasicHeaterMonitor<VirtualClock> monitors[plugCount];
+    report("plugs_16_monitors", n / plugCount, seed, runBench(n / plugCount, [&]()
+                                                             {
+        for (auto &m : monitors)
+            m = BasicHeaterMonitor<VirtualClock>();
+        VirtualClock::set(0); }, [&](size_t i)
+                                                             {
+        VirtualClock::advance(500);
+        for (size_t p = 0; p < plugCount; p++)
+            monitors[p].update(samples[i * plugCount + p], VirtualClock::nowMs());
+        for (size_t p = 0; p < plugCount; p++)
+            monitors[p].update(samples[i * plugCount + p], VirtualClock::nowMs()); }, overhead));
+    PlugTable<VirtualClock, plugCount> table;
+    report("plugs_16_table", n / plugCount, seed, runBench(n / plugCount, [&]()
+                                                          {
+        table = PlugTable<VirtualClock, plugCount>();
+        VirtualClock::set(0); }, [&](size_t i)
+                                                          {
+        VirtualClock::advance(500);
+        for (size_t p = 0; p < plugCount; p++)
+            table.update(p, (int32_t)(samples[i * plugCount + p] * 1000), VirtualClock::nowMs());
+        table.updateAll(); }, overhead));
+
+    // The reading filter on its own, per reading, with the firmware's settings and
+    // with the widest median.
+    ReadingFilter filter;
+    int32_t sinkMa = 0;
+    report("reading_filter", n, seed, runBench(n, [&]()
+                                               { filter = ReadingFilter(); }, [&](size_t i)
+                                               { sinkMa += filter.add((int32_t)(samples[i] * 1000), readingFilterDefault); }, overhead));
+    static constexpr ReadingFilterConfig widest = {READING_FILTER_MAX_WINDOW, 2, READING_FILTER_STEP_MA};
+    report("reading_filter_widest", n, seed, runBench(n, [&]()
+                                                      { filter = ReadingFilter(); }, [&](size_t i)
+                                                      { sinkMa += filter.add((int32_t)(samples[i] * 1000), widest); }, overhead));
+    sinkF = sinkMa;
+
+    // shouldDisplayBeOn() at a given minute of the week: the std::map it used to build
+    // on every call, and the bitmap. Both say the same, which is checked.
+    static constexpr ScheduleSpan spans[] = {{1, 480, 1320}, {2, 480, 1320}, {3, 480, 1320}, {4, 480, 1320},
+                                             {5, 480, 1140}, {6, 480, 1080}, {0, 720, 1080}};
+    static constexpr WeekSchedule week = weekSchedule(spans);
+    uint32_t sinkOn = 0;
+    auto mapSchedule = [](int day, int hour)
+    {
+        std::map<int, std::vector<std::tuple<int, int>>> displaySchedule = {
+            {1, {{8, 22}}}, {2, {{8, 22}}}, {3, {{8, 22}}}, {4, {{8, 22}}}, {5, {{8, 19}}}, {6, {{8, 18}}}, {0, {{12, 18}}}};
+        if (displaySchedule.find(day) != displaySchedule.end())
+            for (const auto &period : displaySchedule.at(day))
+                if (hour >= std::get<0>(period) && hour < std::get<1>(period))
+                    return true;
+        return false;
+    };
+    for (uint32_t m = 0; m < SCHEDULE_WEEK_MINUTES; m++)
+        if (mapSchedule(m / 1440, m / 60 % 24) != week.on(m))
+        {
+            fprintf(stderr, "bench: schedule bitmap disagrees at minute %u\n", m);
+            return 1;
+        }
+    report("schedule_map", n, seed, runBench(n, [] {}, [&](size_t i)
+                                             {
+        uint32_t m = (i * 7919) % SCHEDULE_WEEK_MINUTES;
+        sinkOn += mapSchedule(m / 1440, m / 60 % 24); }, overhead));
+    report("schedule_bitmap", n, seed, runBench(n, [] {}, [&](size_t i)
+                                                {
+        uint32_t m = (i * 7919) % SCHEDULE_WEEK_MINUTES;
+        sinkOn += week.on(m); }, overhead));
+    sinkF = sinkOn;
+
+    // What always-on profiling adds to each timed stage: two cycle counter reads and
+    // the atomic updates.
+    ProfileStage stage("bench");
+    report("profile_record", n, seed, runBench(n, [] {}, [&](size_t)
+                                               { ProfileTimer t(stage); }, overhead));
+
+    // Display. The timer line as updateTimer() redraws it, and a state word as
+    // updateDisplay() does, each flushed to the (simulated) panel. Drawing is far
+    // slower than the above, so these run on a twentieth of the samples.
+    size_t nText = std::max<size_t>(n / 20, 100);
+    MatrixPanel_CC *panel = MatrixPanel_CC::getInstance(HUB75_I2S_CFG(64, 32, 1, {}, HUB75_I2S_CFG::FM6126A));
+    panel->begin();
+    auto timerLine = [&](size_t i)
+    {
+        panel->fillRect(0, 21, 64, 11, 0);
+        panel->setFont(&TomThumb);
+        panel->printAt(0, 31, 0xF800, "%s%u:%02u", "Heating for: ", (unsigned)(i / 60 % 60), (unsigned)(i % 60));
+        panel->flush();
+    };
+    static const char *const words[] = {"HOT", "WARM", "COLD", "OFF"};
+    auto stateWord = [&](size_t i)
+    {
+        panel->fillScreen(0);
+        panel->setFont(&Impact12Caps);
+        panel->printCenter(32, 20, 0xFFFF, words[i & 3]);
+        panel->flush();
+    };
+    // Measuring a runtime string for printRight()/printCenter(): the old way with a
+    // String and getTextBounds(), and the shared TextMetrics routine.
+    static const char *const times[] = {" 7:05 AM", "12:59 PM", "10:30 PM", " 1:00 AM"};
+    panel->setFont(&TomThumb);
+    uint16_t sinkW = 0;
+    report("measure_string_bounds", nText, seed, runBench(nText, [] {}, [&](size_t i)
+                                                         {
+        int16_t x1, y1;
+        uint16_t w, h;
+        const String text = times[i & 3];
+        panel->getTextBounds(text, 0, 12, &x1, &y1, &w, &h);
+        sinkW += w; }, overhead));
+    report("measure_text", nText, seed, runBench(nText, [] {}, [&](size_t i)
+                                                { sinkW += panel->measure(times[i & 3]).w; }, overhead));
+    sinkF = sinkW;
+
+    panel->useGlyphCache(false);
+    report("text_timer_line_gfx", nText, seed, runBench(nText, [] {}, timerLine, overhead));
+    report("text_state_word_gfx", nText, seed, runBench(nText, [] {}, stateWord, overhead));
+    panel->useGlyphCache(true);
+    report("text_timer_line_cached", nText, seed, runBench(nText, [] {}, timerLine, overhead));
+    report("text_state_word_cached", nText, seed, runBench(nText, [] {}, stateWord, overhead));
+
+    // updateTimer() as it runs now: called every pass, with printIn() drawing only
+    // when the second ticks over, here once in five calls.
+    const TextArea bottomLine = {0, 21, 64, 11};
+    report("text_timer_line_area", nText, seed, runBench(nText, [] {}, [&](size_t i)
+                                                        {
+        panel->setFont(&TomThumb);
+        panel->printIn(bottomLine, TextAlign::LEFT, 0, 31, 0xF800, "%s%u:%02u", "Heating for: ",
+                       (unsigned)(i / 300 % 60), (unsigned)(i / 5 % 60));
+        panel->flush(); }, overhead));
+
+    // One scroller frame, a 50ms tick apart, for a short and a long message. The
+    // cost shouldn't depend on the length.
+    static const char shortMsg[] = "Hot tub ready";
+    static char longMsg[200];
+    for (size_t i = 0; i + 1 < sizeof(longMsg); i++)
+        longMsg[i] = "Water 38.5C, heater on since 6:15 AM. "[i % 38];
+    auto scrollFrame = [&](size_t)
+    {
+        nativeAdvanceMillis(50);
+        panel->scrollText();
+        panel->flush();
+    };
+    panel->setFont(&TomThumb);
+    panel->setScrollMessage(shortMsg);
+    report("scroll_frame_short", nText, seed, runBench(nText, [] {}, scrollFrame, overhead));
+    panel->setScrollMessage(longMsg);
+    report("scroll_frame_long", nText, seed, runBench(nText, [] {}, scrollFrame, overhead));
+
+    return 0;
+}
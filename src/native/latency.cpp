@@ -0,0 +1,357 @@
+// End to end latency, from a reading going out on the wire to the frame that shows
+// it, on the host.
+//
+//   pio run -e native_latency && .pio/build/native_latency/program --loads 0,100,1000 --trials 50
+//   .pio/build/native_latency/program --poll-ms 10   # the old fixed-delay loop, to compare
+//
+// Runs the sim (sim.cpp) in this process and watches every frame render flushes. A
+// trial resets the monitor, settles it at OFF with a 0A reading, then timestamps
+// GET /current?value=12.5 and waits for the first frame whose state word area (rows
+// 1-20, under the plug dots) no longer shows OFF. That's the OFF to WARM change, the one people
+// stand in front of the sign waiting for. The reading filter's median needs more
+// than one reading to move (ReadingFilter.hpp), so the probe sends window / 2 + 1 of
+// them (--filter-window, the firmware's by default) --report-ms apart, as a plug
+// would, and the time is from the first. What the filter holds a change up by is
+// part of the number: about --report-ms with the default window.
+//
+// Each load level runs the trials while other threads send 0A readings at that many
+// per second over a few keep-alive connections, with some idle connections open too.
+// They're plug 1's, so they only get in the way, and don't end up in plug 0's
+// median. The panel stays on plug 0 rather than paging between them, and the display
+// schedule is set to all day, so when the trials run doesn't change what they see. Trials are a random 0-gap ms apart, so they land anywhere in the render
+// timer's (or the poll's) period and the load has time to build up. Mind
+// HTTP_MAX_CONNECTIONS: the load, the idle ones and the probe all count, and past it
+// the server starts evicting. One JSON object per load level goes to stdout, like
+// bench; the table goes to stderr.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../UdpIngest.hpp"
+#include "sim.hpp"
+
+#define STATE_TOP 1           // Row 0 is the plug dots
+#define STATE_ROWS 20         // Then the state word, the timer line is below
+#define PANEL_WIDTH 64
+#define SETTLE_TIMEOUT_MS 2000
+#define CHANGE_TIMEOUT_MS 5000
+
+typedef std::chrono::steady_clock LatencyClock;
+
+static uint16_t port = 8090;
+static bool udpProbe = false;
+static int probeReadings = 1; // For the filter's median to take the new current
+static int reportMs = 500;    // Between them, as PlugMock reports
+
+// What the frame hook saw, guarded by frameLock.
+static std::mutex frameLock;
+static std::condition_variable frameChanged;
+static uint64_t shownHash = 0;
+static uint64_t offHash = 0;
+static bool armed = false; // Waiting for the state area to leave offHash
+static LatencyClock::time_point changedAt;
+
+static uint64_t stateAreaHash(const uint16_t *frame)
+{
+    uint64_t h = 14695981039346656037ull; // FNV-1a
+    for (int i = STATE_TOP * PANEL_WIDTH; i < (STATE_TOP + STATE_ROWS) * PANEL_WIDTH; i++)
+    {
+        h ^= frame[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void onFrame(const uint16_t *frame)
+{
+    LatencyClock::time_point now = LatencyClock::now();
+    uint64_t h = stateAreaHash(frame);
+    std::lock_guard<std::mutex> lock(frameLock);
+    shownHash = h;
+    if (armed && h != offHash)
+    {
+        armed = false;
+        changedAt = now;
+    }
+    frameChanged.notify_all();
+}
+
+static int connectServer()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Reads one response off a keep-alive connection. False if it closed or broke.
+static bool readResponse(int fd)
+{
+    char buf[1024];
+    size_t len = 0;
+    char *body = nullptr;
+    size_t need = 0;
+    for (;;)
+    {
+        ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0)
+            return false;
+        len += n;
+        buf[len] = 0;
+        if (!body && (body = strstr(buf, "\r\n\r\n")))
+        {
+            body += 4;
+            const char *cl = strcasestr(buf, "content-length:");
+            need = (body - buf) + (cl ? strtoul(cl + 15, nullptr, 10) : 0);
+        }
+        if (body && len >= need)
+            return true;
+        if (len == sizeof(buf) - 1)
+            return false;
+    }
+}
+
+// One GET on a connection of its own, Connection: close.
+static bool get(const char *path)
+{
+    int fd = connectServer();
+    if (fd < 0)
+        return false;
+    char req[128];
+    int len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: sim\r\nConnection: close\r\n\r\n", path);
+    bool ok = send(fd, req, len, 0) == len && readResponse(fd);
+    close(fd);
+    return ok;
+}
+
+static bool sendReading(int32_t milliamps)
+{
+    if (!udpProbe)
+    {
+        char path[48];
+        snprintf(path, sizeof(path), "/current?value=%d.%03d", milliamps / 1000, milliamps % 1000);
+        return get(path);
+    }
+    static int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    static uint32_t seq = 0;
+    UdpReadingPacket packet = {{'H', 'P'}, 1, 0, seq++, milliamps}; // Plug 0, like /current's default
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return sendto(fd, &packet, sizeof(packet), 0, (sockaddr *)&addr, sizeof(addr)) == sizeof(packet);
+}
+
+// 0A readings at perSecond on one keep-alive connection, until stop.
+static void loadThread(uint32_t perSecond, const std::atomic<bool> *stop)
+{
+    static const char req[] = "GET /current?value=0&plug=1 HTTP/1.1\r\nHost: load\r\n\r\n";
+    int fd = -1;
+    LatencyClock::time_point next = LatencyClock::now();
+    LatencyClock::duration gap = std::chrono::microseconds(1000000 / perSecond);
+    while (!*stop)
+    {
+        if (fd < 0)
+            fd = connectServer();
+        if (fd >= 0 && (send(fd, req, sizeof(req) - 1, MSG_NOSIGNAL) != sizeof(req) - 1 || !readResponse(fd)))
+        {
+            close(fd);
+            fd = -1;
+        }
+        next += gap;
+        if (next < LatencyClock::now() - std::chrono::milliseconds(100))
+            next = LatencyClock::now(); // Fell behind; don't make up for it in a burst
+        std::this_thread::sleep_until(next);
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+// Back to OFF and showing it. False if it never got there.
+static bool settleOff()
+{
+    if (!get("/sim/reset") || !sendReading(0))
+        return false;
+    std::unique_lock<std::mutex> lock(frameLock);
+    return frameChanged.wait_for(lock, std::chrono::milliseconds(SETTLE_TIMEOUT_MS), []
+                                 { return shownHash == offHash; });
+}
+
+// One OFF to WARM, in ms, or -1 if the frame never changed.
+static double trial()
+{
+    if (!settleOff())
+        return -1;
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
+        armed = true;
+    }
+    LatencyClock::time_point sent = LatencyClock::now();
+    for (int i = 0; i < probeReadings; i++)
+    {
+        std::this_thread::sleep_until(sent + std::chrono::milliseconds(i * reportMs));
+        if (!sendReading(12500))
+            return -1;
+    }
+    std::unique_lock<std::mutex> lock(frameLock);
+    if (!frameChanged.wait_for(lock, std::chrono::milliseconds(CHANGE_TIMEOUT_MS), []
+                               { return !armed; }))
+    {
+        armed = false;
+        return -1;
+    }
+    return std::chrono::duration<double, std::milli>(changedAt - sent).count();
+}
+
+int main(int argc, char **argv)
+{
+    SimConfig config;
+    std::vector<uint32_t> loads = {0, 100, 1000};
+    int trials = 50;
+    int connections = 2;
+    int idle = 2;
+    int gapMs = 50;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--loads") && i + 1 < argc)
+        {
+            loads.clear();
+            for (char *s = argv[++i]; *s; s += *s == ',')
+                loads.push_back(strtoul(s, &s, 10));
+        }
+        else if (!strcmp(argv[i], "--trials") && i + 1 < argc)
+            trials = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--connections") && i + 1 < argc)
+            connections = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--idle") && i + 1 < argc)
+            idle = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--gap-ms") && i + 1 < argc)
+            gapMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tick-ms") && i + 1 < argc)
+            config.timerTickMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+            config.batch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--poll-ms") && i + 1 < argc)
+            config.pollMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--double-buffer"))
+            config.doubleBuffer = true;
+        else if (!strcmp(argv[i], "--udp"))
+            udpProbe = true;
+        else if (!strcmp(argv[i], "--filter-window") && i + 1 < argc)
+            config.filter.window = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--report-ms") && i + 1 < argc)
+            reportMs = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: latency [--loads N,N,..] [--trials N] [--gap-ms N] [--connections N] [--idle N] [--port P]\n"
+                            "               [--tick-ms N] [--batch N] [--poll-ms N] [--double-buffer] [--udp] [--filter-window N]\n"
+                            "               [--report-ms N]\n");
+            return 2;
+        }
+    }
+    if (trials < 1 || connections < 1 || gapMs < 1 || reportMs < 0 || !config.filter.valid())
+        return 2;
+    probeReadings = config.filter.window / 2 + 1;
+
+    config.port = port;
+    config.pageMs = 0;
+    simOnFrame(onFrame);
+    if (!simStart(config))
+        return 1;
+
+    // What OFF looks like, from the first settle.
+    get("/schedule?set=sun-sat%2000:00-24:00");
+    get("/sim/reset");
+    sendReading(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    {
+        std::lock_guard<std::mutex> lock(frameLock);
+        offHash = shownHash;
+    }
+
+    fprintf(stderr,
+            "latency: OFF to WARM over %s, tick %u ms, batch %u, %s%s, filter window %u, reports %d ms apart, "
+            "%d trials per load\n",
+            udpProbe ? "udp" : "http", config.timerTickMs, config.batch, config.pollMs ? "polling" : "event driven",
+            config.doubleBuffer ? ", double buffered" : "", config.filter.window, reportMs, trials);
+    if (config.pollMs)
+        fprintf(stderr, "latency: polling every %u ms\n", config.pollMs);
+    std::mt19937 rng(1);
+    for (uint32_t load : loads)
+    {
+        std::atomic<bool> stopLoad{false};
+        std::vector<std::thread> loaders;
+        for (int c = 0; load && c < connections; c++)
+            loaders.emplace_back(loadThread, (load + connections - 1) / connections, &stopLoad);
+        std::vector<int> idlers;
+        for (int c = 0; c < idle; c++)
+        {
+            int fd = connectServer();
+            if (fd >= 0 && send(fd, "GET /current?val", 16, 0) == 16)
+                idlers.push_back(fd);
+        }
+        std::vector<double> ms;
+        int missed = 0;
+        for (int t = 0; t < trials; t++)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(rng() % (gapMs * 1000)));
+            double latency = trial();
+            if (latency < 0)
+                missed++;
+            else
+                ms.push_back(latency);
+        }
+        stopLoad = true;
+        for (std::thread &loader : loaders)
+            loader.join();
+        for (int fd : idlers)
+            close(fd);
+
+        double p50 = 0, p99 = 0, max = 0;
+        if (!ms.empty())
+        {
+            std::sort(ms.begin(), ms.end());
+            p50 = ms[ms.size() / 2];
+            p99 = ms[(ms.size() * 99) / 100];
+            max = ms.back();
+        }
+        fprintf(stderr, "load %6u/s   p50 %8.3f ms   p99 %8.3f ms   max %8.3f ms   missed %d\n", load, p50, p99, max,
+                missed);
+        printf("{\"bench\":\"off_to_warm_%u\",\"load_per_s\":%u,\"trials\":%d,\"missed\":%d,\"probe\":\"%s\","
+               "\"tick_ms\":%u,\"batch\":%u,\"poll_ms\":%u,\"double_buffer\":%s,\"filter_window\":%u,\"report_ms\":%d,"
+               "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+               load, load, trials, missed, udpProbe ? "udp" : "http", config.timerTickMs, config.batch, config.pollMs,
+               config.doubleBuffer ? "true" : "false", config.filter.window, reportMs, p50, p99, max);
+        fflush(stdout);
+    }
+
+    simStop();
+    simJoin();
+    return 0;
+}
@@ -0,0 +1,244 @@
+// Host replay of a PlugMock-style trace through a plug's filter and state machine
+// (PlugTable) on virtual time.
+//
+//   pio run -e native && .pio/build/native/program test/input.txt
+//   .pio/build/native/program --noise 0.3 --glitches 0.02 test/hot_to_warm.txt
+//   .pio/build/native/program --home-testing test/home_lamp.txt
+//
+// Plug reports arrive every --report-ms (PlugMock uses 500ms) and loop() runs every
+// --tick-ms, both on VirtualClock. After the trace runs out we keep sending 0A for
+// --tail-s seconds, like PlugMock does forever. Nothing sleeps, so hours of heater
+// time take milliseconds.
+//
+// Real plugs aren't as clean as a trace: --noise adds that many amps of gaussian noise
+// to every reading with current, and --glitches makes that fraction of readings
+// anything from 0 to 15A. The trace then runs again with the filter off, on the same
+// readings, to show how many trend changes and redraws (state or trend changes, each
+// of which wakes render) the filter saved, or added.
+//
+// On a clean trace (no --noise or --glitches) the filter should only hold changes up,
+// never change which states the plug goes through. The replay says how long they
+// were held up and exits 1 if the states differ.
+//
+// --home-testing runs homeTestingProfile instead of the build's profile.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <Arduino.h>
+#include "../PlugTable.hpp"
+#include "Trace.hpp"
+
+struct ReplayOptions
+{
+    unsigned long tickMs = 10;
+    unsigned long reportMs = 500;
+    float noiseA = 0;
+    float glitches = 0;
+    unsigned seed = 1;
+};
+
+struct StateChange
+{
+    uint64_t ms;
+    HeaterState to;
+};
+
+struct ReplayCounts
+{
+    unsigned long long ticks, reports;
+    unsigned stateChanges, trendChanges, redraws;
+    HeaterState state;
+    HeaterTrend trend;
+    std::vector<StateChange> states;
+};
+
+// The trace once through plug 0 of a table filtering with filter.
+template <const HeaterProfile &Profile>
+static ReplayCounts replay(const std::vector<TraceStep> &steps, const ReplayOptions &options,
+                           const ReadingFilterConfig &filter)
+{
+    std::mt19937 rng(options.seed);
+    std::normal_distribution<float> noise(0.0f, options.noiseA > 0 ? options.noiseA : 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    PlugTable<VirtualClock, 1, Profile> plugs;
+    plugs.setFilter(filter);
+    ReplayCounts counts = {};
+    uint64_t nextReport = 0;
+    HeaterSnapshot shown = plugs.snapshot(0);
+
+    VirtualClock::set(0);
+    for (const TraceStep &step : steps)
+    {
+        uint64_t stepEnd = VirtualClock::nowMs() + (uint64_t)(step.durationS * 1000);
+        while (VirtualClock::nowMs() < stepEnd)
+        {
+            bool reported = false;
+            if (VirtualClock::nowMs() >= nextReport)
+            {
+                if (step.current != -1)
+                {
+                    float current = step.current;
+                    if (options.noiseA > 0 && current > 0)
+                        current += noise(rng);
+                    if (options.glitches > 0 && unit(rng) < options.glitches)
+                        current = unit(rng) * 15.0f;
+                    plugs.update(0, lroundf((current > 0 ? current : 0) * 1000), VirtualClock::nowMs());
+                    counts.reports++;
+                    reported = true;
+                }
+                nextReport += options.reportMs;
+            }
+            if (!reported)
+                plugs.updateAll();
+            counts.ticks++;
+
+            HeaterSnapshot now = plugs.snapshot(0);
+            counts.stateChanges += now.state != shown.state;
+            counts.trendChanges += now.trend != shown.trend;
+            counts.redraws += now.state != shown.state || now.trend != shown.trend;
+            if (now.state != shown.state)
+                counts.states.push_back({VirtualClock::nowMs(), now.state});
+            shown = now;
+            VirtualClock::advance(options.tickMs);
+        }
+    }
+    counts.state = plugs.state(0);
+    counts.trend = plugs.trend(0);
+    return counts;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: replay [-q] [--tick-ms N] [--report-ms N] [--tail-s N] [--noise A] [--glitches F] [--seed N]\n"
+                    "              [--home-testing] [--filter-window N] [--ema-shift N] [--step-ma N] trace.txt\n");
+}
+
+// Unfiltered minus filtered, as saved and added rather than one signed number.
+static void printDifference(const char *what, unsigned unfiltered, unsigned filtered)
+{
+    printf("%s %u %s", unfiltered >= filtered ? "saved" : "added",
+           unfiltered >= filtered ? unfiltered - filtered : filtered - unfiltered, what);
+}
+
+// Both runs once through, the filtered one printing as it goes. Returns main()'s exit code.
+template <const HeaterProfile &Profile>
+static int run(const char *tracePath, const std::vector<TraceStep> &steps, const ReplayOptions &options,
+               const ReadingFilterConfig &filter)
+{
+    auto wallStart = std::chrono::steady_clock::now();
+    ReplayCounts counts = replay<Profile>(steps, options, filter);
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallStart).count();
+    double simMs = VirtualClock::nowMs();
+
+    Serial.setOutput(nullptr);
+    ReplayCounts unfiltered = replay<Profile>(steps, options, readingFilterOff);
+
+    printf("replay: %s simulated %.1f s, %llu reports, %llu loop passes, %u state changes, final state %d trend %d\n",
+           tracePath, simMs / 1000, counts.reports, counts.ticks, counts.stateChanges, (int)counts.state, (int)counts.trend);
+    printf("replay: filter window %u, ema shift %u, step %d mA: %u trend changes, %u redraws; "
+           "unfiltered %u state changes, %u trend changes, %u redraws; ",
+           filter.window, filter.emaShift, filter.stepMa, counts.trendChanges, counts.redraws, unfiltered.stateChanges,
+           unfiltered.trendChanges, unfiltered.redraws);
+    printDifference("trend changes, ", unfiltered.trendChanges, counts.trendChanges);
+    printDifference("redraws\n", unfiltered.redraws, counts.redraws);
+
+    bool sameStates = counts.states.size() == unfiltered.states.size();
+    uint64_t maxLateMs = 0;
+    for (size_t i = 0; sameStates && i < counts.states.size(); i++)
+    {
+        sameStates = counts.states[i].to == unfiltered.states[i].to;
+        if (counts.states[i].ms > unfiltered.states[i].ms && counts.states[i].ms - unfiltered.states[i].ms > maxLateMs)
+            maxLateMs = counts.states[i].ms - unfiltered.states[i].ms;
+    }
+    if (sameStates)
+        printf("replay: same states as unfiltered, each up to %llu ms later\n", (unsigned long long)maxLateMs);
+    else
+    {
+        printf("replay: states differ from unfiltered:");
+        for (const StateChange &c : counts.states)
+            printf(" %s@%llu", heaterStateNames[(int)c.to], (unsigned long long)c.ms);
+        printf(" vs");
+        for (const StateChange &c : unfiltered.states)
+            printf(" %s@%llu", heaterStateNames[(int)c.to], (unsigned long long)c.ms);
+        printf("\n");
+    }
+    printf("replay: %.2f ms wall, %.0fx real time\n", wallMs, wallMs > 0 ? simMs / wallMs : 0);
+
+    bool clean = options.noiseA <= 0 && options.glitches <= 0;
+    return clean && !sameStates ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *tracePath = "test/input.txt";
+    ReplayOptions options;
+    int window = -1, emaShift = -1, stepMa = -1; // The profile's unless given
+    unsigned long tailS = 0;
+    bool quiet = false;
+    bool homeTesting = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-q"))
+            quiet = true;
+        else if (!strcmp(argv[i], "--tick-ms") && i + 1 < argc)
+            options.tickMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--report-ms") && i + 1 < argc)
+            options.reportMs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--tail-s") && i + 1 < argc)
+            tailS = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--noise") && i + 1 < argc)
+            options.noiseA = strtof(argv[++i], nullptr);
+        else if (!strcmp(argv[i], "--glitches") && i + 1 < argc)
+            options.glitches = strtof(argv[++i], nullptr);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--home-testing"))
+            homeTesting = true;
+        else if (!strcmp(argv[i], "--filter-window") && i + 1 < argc)
+            window = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ema-shift") && i + 1 < argc)
+            emaShift = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--step-ma") && i + 1 < argc)
+            stepMa = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            usage();
+            return 2;
+        }
+        else
+            tracePath = argv[i];
+    }
+    ReadingFilterConfig filter = readingFilterFor(homeTesting ? homeTestingProfile : HEATER_PROFILE);
+    if (window >= 0)
+        filter.window = window;
+    if (emaShift >= 0)
+        filter.emaShift = emaShift;
+    if (stepMa >= 0)
+        filter.stepMa = stepMa;
+    if (options.tickMs == 0 || options.reportMs == 0 || !filter.valid())
+    {
+        usage();
+        return 2;
+    }
+
+    std::vector<TraceStep> steps;
+    if (!loadTrace(tracePath, steps))
+    {
+        fprintf(stderr, "replay: can't read %s\n", tracePath);
+        return 1;
+    }
+    steps.push_back({0.0f, (float)tailS});
+
+    if (quiet)
+        Serial.setOutput(nullptr);
+    if (homeTesting)
+        return run<homeTestingProfile>(tracePath, steps, options, filter);
+    return run<HEATER_PROFILE>(tracePath, steps, options, filter);
+}
@@ -0,0 +1,29 @@
+// HttpServer and UdpIngest on the host, for load testing with test/load_gen.py.
+//
+//   pio run -e native_server && .pio/build/native_server/program [port]
+//   python test/load_gen.py --port 8080 --clients 50 --idle 20
+//
+// The firmware mirror itself is in sim.cpp.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+
+#include "sim.hpp"
+
+int main(int argc, char **argv)
+{
+    SimConfig config;
+    if (argc > 1)
+        config.port = atoi(argv[1]);
+
+    signal(SIGINT, [](int)
+           { simStop(); });
+    signal(SIGTERM, [](int)
+           { simStop(); });
+    if (!simStart(config))
+        return 1;
+    fprintf(stderr, "server: listening on %u (tcp and udp)\n", config.port);
+    simJoin();
+    return 0;
+}
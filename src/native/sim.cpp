@@ -0,0 +1,84 @@
+// The firmware's ingest and render tasks on the host, for the host tools: the load
+// test server (server.cpp) and the latency harness (latency.cpp). See sim.hpp.
+//
+// Everything the sign does is SignTasks.cpp, the same file the firmware builds, so
+// the routes, /stats, /metrics, the tasks and what they draw are the firmware's. They
+// run here as threads (see lib/NativeShim/freertos/task.h) on localhost, with HTTP and
+// UDP on the same port number, and the panel is NativeShim's. What's only here: a
+// /clients with nobody on it, /sim/reset, and a summary when the tasks finish.
+//
+// The sim's clock runs an hour ahead of when it started, so a fresh monitor's startup
+// timeout has long passed: after /sim/reset one 0A reading puts it straight to OFF.
+
+#include <cstdio>
+
+#include <Arduino.h>
+#include "freertos/task.h"
+#include "MatrixPanel_CC.h"
+#include "../SignTasks.hpp"
+#include "sim.hpp"
+
+static SimConfig config;
+MatrixPanel_CC *dmaDisplay = nullptr;
+
+static void handleClients(HttpRequest &, HttpResponse &response)
+{
+    response.send(200, "text/plain", "Clients: 0\n");
+}
+
+// Host only: start again with a fresh monitor for every plug, for the latency harness.
+static void handleReset(HttpRequest &, HttpResponse &response)
+{
+    plugs = SignPlugs();
+    plugs.setFilter(config.filter);
+    publishSignState();
+    response.send(200, "text/plain", "Reset\n");
+}
+
+bool simStart(const SimConfig &simConfig)
+{
+    config = simConfig;
+    signOptions.timerTickMs = config.timerTickMs;
+    signOptions.batch = config.batch;
+    signOptions.pollMs = config.pollMs;
+    signOptions.pageMs = config.pageMs;
+    plugs.setFilter(config.filter);
+    nativeUseRealTime(true);
+    nativeAdvanceMillis(60 * 60 * 1000);
+    Serial.setOutput(nullptr);
+    dmaDisplay = MatrixPanel_CC::getInstance(HUB75_I2S_CFG(64, 32, 1, {}, HUB75_I2S_CFG::FM6126A, config.doubleBuffer));
+    dmaDisplay->begin();
+    loadSchedule();
+
+    server.on("/clients", HttpMethod::GET, handleClients);
+    server.on("/sim/reset", HttpMethod::GET, handleReset);
+    signRoutes();
+    if (!signListen(config.port, config.port))
+    {
+        fprintf(stderr, "sim: can't listen on %u\n", config.port);
+        return false;
+    }
+    history.begin(0); // The host has heap to spare
+
+    signStartTasks();
+    return true;
+}
+
+void simOnFrame(SimFrameHook hook)
+{
+    signOptions.onFrame = hook;
+}
+
+void simStop()
+{
+    signStop();
+}
+
+void simJoin()
+{
+    nativeJoinTasks();
+    const HttpStats &stats = server.stats();
+    fprintf(stderr, "sim: %u requests, %u evicted, %u timeouts, peak %u connections, %u ingest and %u render wakeups\n",
+            stats.requests, stats.evicted, stats.timeouts, stats.peakActive,
+            ingestScheduler.stats().wakeups, renderScheduler.stats().wakeups);
+}
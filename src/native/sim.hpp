@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "../ReadingFilter.hpp"
+
+// The firmware's two tasks, HTTP and UDP ingest and the simulated panel, running in
+// this process (sim.cpp, on SignTasks.cpp). server.cpp serves it for load_gen.py;
+// latency.cpp drives it and watches the frames it draws.
+
+struct SimConfig
+{
+    uint16_t port = 8080;
+    uint32_t timerTickMs = 200; // Render's redraw timer
+    uint32_t batch = 32;        // Most readings ingest drains a pass
+    uint32_t pollMs = 0;        // Non-zero: both tasks wake on a fixed delay, like the old loop
+    uint32_t pageMs = 5000;     // Plugs take turns on the panel this long, 0 for plug 0 only
+    bool doubleBuffer = false;
+    ReadingFilterConfig filter = readingFilterDefault; // Each plug's, as the firmware's
+};
+
+// Called on the render thread after each flush that changed any pixels, with the
+// frame as the panel now shows it (64x32, RGB565, row by row).
+typedef void (*SimFrameHook)(const uint16_t *frame);
+
+// Listens and starts the tasks. False if the port is taken.
+bool simStart(const SimConfig &config);
+void simOnFrame(SimFrameHook hook);
+// Asks the tasks to finish; safe from a signal handler.
+void simStop();
+// Waits for them, then prints a summary to stderr.
+void simJoin();
@@ -1,9 +1,28 @@
+import argparse
+import socket
+import struct
 import time
 import requests
 from threading import Event
 
+HOST = "192.168.4.1"
+UDP_PORT = 4210
+use_udp = False
+udp_sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+udp_seq = 0
+
+def send_datagram(value):
+    # Same reading as /current, as a 12 byte packet: "HP", version, plug, seq, milliamps
+    global udp_seq
+    udp_seq += 1
+    udp_sock.sendto(struct.pack("<2sBBIi", b"HP", 1, 0, udp_seq, round(value * 1000)), (HOST, UDP_PORT))
+    print(f"Sent datagram: {value} seq {udp_seq}")
+
 def send_request(value):
-    url = f"http://192.168.4.1/current?value={value}"
+    if use_udp:
+        send_datagram(value)
+        return
+    url = f"http://{HOST}/current?value={value}"
     try:
         response = requests.get(url)
         print(f"Sent request: {url}")
@@ -24,6 +43,14 @@ def process_input(current, duration):
         Event().wait(0.5)
 
 def main():
+    global HOST, UDP_PORT, use_udp
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--host", default=HOST)
+    parser.add_argument("--udp", action="store_true", help="send readings over UDP instead of GET /current")
+    parser.add_argument("--udp-port", type=int, default=UDP_PORT)
+    args = parser.parse_args()
+    HOST, UDP_PORT, use_udp = args.host, args.udp_port, args.udp
+
     input_file = "input.txt"  # Name of your input file
     
     with open(input_file, 'r') as file:
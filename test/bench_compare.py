@@ -0,0 +1,32 @@
+import json
+import sys
+
+# Compare two bench runs (JSON lines from the native_bench env).
+#   python bench_compare.py before.jsonl after.jsonl
+
+def load(path):
+    with open(path, 'r') as file:
+        return {r["bench"]: r for r in map(json.loads, file) if r}
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: bench_compare.py before.jsonl after.jsonl")
+        sys.exit(2)
+
+    before = load(sys.argv[1])
+    after = load(sys.argv[2])
+
+    print(f"{'bench':24} {'ns/op':>18} {'p50 ns':>18} {'p99 ns':>18}")
+    for name in after:
+        if name not in before:
+            print(f"{name:24} (new)")
+            continue
+        cols = []
+        for key in ("ns_per_op", "p50_ns", "p99_ns"):
+            b, a = before[name][key], after[name][key]
+            change = (a - b) / b * 100 if b else 0
+            cols.append(f"{a:9.1f} {change:+7.1f}%")
+        print(f"{name:24} " + " ".join(cols))
+
+if __name__ == "__main__":
+    main()
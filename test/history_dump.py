@@ -0,0 +1,31 @@
+import struct
+import sys
+import requests
+
+# Fetch /history from the ESP and print it as CSV: uptime seconds, amps.
+# "no reading" samples (plug went quiet) print as an empty amps column.
+#   python history_dump.py [host]
+
+HEADER = struct.Struct("<4sIIIIIIHH")
+NO_READING = 0xFFF
+
+def main():
+    host = sys.argv[1] if len(sys.argv) > 1 else "192.168.4.1"
+    data = requests.get(f"http://{host}/history").content
+
+    magic, count, capacity, oldest, newest, now, epoch, ma_per_unit, _ = HEADER.unpack_from(data)
+    if magic != b"HPH1":
+        print(f"Bad magic {magic}")
+        sys.exit(1)
+    print(f"# {count}/{capacity} samples, uptime {oldest}..{newest}s, now {now}s, epoch {epoch}")
+
+    t = oldest
+    words = struct.unpack_from(f"<{count}H", data, HEADER.size)
+    for i, word in enumerate(words):
+        if i:
+            t += word >> 12
+        value = word & 0xFFF
+        print(f"{t},{'' if value == NO_READING else value * ma_per_unit / 1000}")
+
+if __name__ == "__main__":
+    main()
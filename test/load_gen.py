@@ -0,0 +1,171 @@
+import argparse
+import asyncio
+import random
+import socket
+import statistics
+import struct
+import time
+
+# Load generator for the HTTP server. Point it at the native_server build (or the
+# ESP itself) and it will, all at once:
+#   - open --idle connections that never finish their request (half-open clients)
+#   - run --clients concurrent plug reporters, each doing --requests GET /current
+# then print latency percentiles and the server's /stats.
+#   python load_gen.py --host 127.0.0.1 --port 8080 --clients 50 --idle 20
+# With --udp the reporters send UDP reading datagrams instead (no reply, so no
+# latency). Against native_server both modes print the server CPU per reading,
+# from the cpu_us it reports in /stats.
+#   python load_gen.py --udp --clients 50 --idle 0
+# --keep-alive has each reporter reuse one connection, --pipeline N sends N
+# requests at a time on it before reading the responses.
+#   python load_gen.py --keep-alive --pipeline 4 --clients 4 --idle 0
+# --interval S spaces each reporter's requests like a plug's. With more reporters
+# than the server has connections, that checks none of theirs is evicted between
+# reports and none of them loses a reading; it exits 1 if either happens.
+#   python load_gen.py --keep-alive --interval 1 --clients 16 --requests 10 --idle 0
+
+async def http_get(host, port, path):
+    reader, writer = await asyncio.open_connection(host, port)
+    writer.write(f"GET {path} HTTP/1.1\r\nHost: {host}\r\nConnection: close\r\n\r\n".encode())
+    await writer.drain()
+    data = await reader.read()
+    writer.close()
+    status = int(data.split(b" ", 2)[1]) if data.startswith(b"HTTP/") else 0
+    return status, data
+
+async def idle_client(host, port, hold):
+    try:
+        reader, writer = await asyncio.open_connection(host, port)
+        writer.write(b"GET /current?val")  # and never finish it
+        await writer.drain()
+        await asyncio.sleep(hold)
+        writer.close()
+    except OSError:
+        pass
+
+async def read_response(reader):
+    head = await reader.readuntil(b"\r\n\r\n")
+    length = 0
+    for line in head.split(b"\r\n"):
+        if line.lower().startswith(b"content-length:"):
+            length = int(line.split(b":", 1)[1])
+    await reader.readexactly(length)
+    return int(head.split(b" ", 2)[1]), b"connection: close" in head.lower()
+
+async def persistent_reporter(host, port, requests, pipeline, interval, latencies, errors):
+    reader = writer = None
+    sent = 0
+    await asyncio.sleep(random.uniform(0, interval))  # plugs aren't in step
+    while sent < requests:
+        if sent:
+            await asyncio.sleep(interval)
+        batch = min(pipeline, requests - sent)
+        sent += batch
+        start = time.perf_counter()
+        try:
+            if writer is None:
+                reader, writer = await asyncio.open_connection(host, port)
+            for _ in range(batch):
+                value = random.choice([0, 0.14, 7.5, 12.5])
+                writer.write(f"GET /current?value={value} HTTP/1.1\r\nHost: {host}\r\n\r\n".encode())
+            await writer.drain()
+            for _ in range(batch):
+                status, closed = await read_response(reader)
+                if status == 200:
+                    latencies.append((time.perf_counter() - start) * 1000)
+                else:
+                    errors[status] = errors.get(status, 0) + 1
+                if closed:
+                    break
+        except (OSError, asyncio.IncompleteReadError):
+            closed = True
+            errors[0] = errors.get(0, 0) + 1
+        if closed and writer is not None:
+            writer.close()
+            reader = writer = None
+    if writer is not None:
+        writer.close()
+
+async def reporter(host, port, requests, latencies, errors):
+    for _ in range(requests):
+        value = random.choice([0, 0.14, 7.5, 12.5])
+        start = time.perf_counter()
+        try:
+            status, _ = await http_get(host, port, f"/current?value={value}")
+        except OSError:
+            status = 0
+        if status == 200:
+            latencies.append((time.perf_counter() - start) * 1000)
+        else:
+            errors[status] = errors.get(status, 0) + 1
+
+async def udp_reporter(host, port, plug, requests):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    for seq in range(requests):
+        value = random.choice([0, 0.14, 7.5, 12.5])
+        sock.sendto(struct.pack("<2sBBIi", b"HP", 1, plug, seq, round(value * 1000)), (host, port))
+        await asyncio.sleep(0.0005)  # don't just overrun the socket buffer
+    sock.close()
+
+async def server_stats(host, port):
+    _, data = await http_get(host, port, "/stats")
+    body = data.split(b"\r\n\r\n", 1)[-1].decode()
+    return body, dict(line.split(" ", 1) for line in body.splitlines() if " " in line)
+
+async def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--clients", type=int, default=20)
+    parser.add_argument("--requests", type=int, default=50)
+    parser.add_argument("--idle", type=int, default=4)
+    parser.add_argument("--hold", type=float, default=5.0, help="seconds idle clients hang on")
+    parser.add_argument("--udp", action="store_true", help="report over UDP instead of GET /current")
+    parser.add_argument("--keep-alive", action="store_true", help="reuse one connection per reporter")
+    parser.add_argument("--pipeline", type=int, default=1, help="requests in flight per connection, with --keep-alive")
+    parser.add_argument("--interval", type=float, default=0.0, help="seconds between a reporter's requests, with --keep-alive")
+    args = parser.parse_args()
+
+    latencies = []
+    errors = {}
+    _, before = await server_stats(args.host, args.port)
+    idle = [asyncio.create_task(idle_client(args.host, args.port, args.hold)) for _ in range(args.idle)]
+    await asyncio.sleep(0.2)
+
+    start = time.perf_counter()
+    if args.udp:
+        await asyncio.gather(*[udp_reporter(args.host, args.port, plug % 256, args.requests) for plug in range(args.clients)])
+    elif args.keep_alive:
+        await asyncio.gather(*[persistent_reporter(args.host, args.port, args.requests, args.pipeline, args.interval,
+                                                   latencies, errors)
+                               for _ in range(args.clients)])
+    else:
+        await asyncio.gather(*[reporter(args.host, args.port, args.requests, latencies, errors) for _ in range(args.clients)])
+    elapsed = time.perf_counter() - start
+    await asyncio.gather(*idle)
+    await asyncio.sleep(0.1)  # let the last datagrams get polled
+
+    body, after = await server_stats(args.host, args.port)
+    if args.udp:
+        ok = int(after["udp_accepted"]) - int(before.get("udp_accepted", 0))
+        print(f"{ok} of {args.clients * args.requests} accepted, {ok / elapsed:.0f} readings/s")
+    else:
+        ok = len(latencies)
+        print(f"{ok} ok, errors {errors or 'none'}, {ok / elapsed:.0f} req/s")
+        if ok:
+            latencies.sort()
+            print(f"latency ms: p50 {statistics.median(latencies):.2f}  p99 {latencies[int(ok * 0.99) - 1]:.2f}  max {latencies[-1]:.2f}")
+    if ok and "cpu_us" in after:
+        # Includes the /stats request and select() wakeups, so a slight overestimate.
+        print(f"server cpu per reading: {(int(after['cpu_us']) - int(before['cpu_us'])) / ok:.1f} us")
+    print(body)
+    if args.keep_alive and args.interval:
+        evicted = int(after["connections_evicted"]) - int(before["connections_evicted"])
+        reused = int(after["requests_reused"]) - int(before["requests_reused"])
+        print(f"keep-alive: {reused} of {args.clients * args.requests} requests reused a connection, {evicted} evicted")
+        if evicted or errors:
+            return 1
+    return 0
+
+if __name__ == "__main__":
+    raise SystemExit(asyncio.run(main()))